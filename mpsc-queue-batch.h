@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+#ifndef MPSC_QUEUE_BATCH_H
+#define MPSC_QUEUE_BATCH_H
+
+/* Producer-side batching for 'mpsc-queue.h'.
+ *
+ * A producer handle links nodes as they are inserted, and publishes
+ * them with a single 'mpsc_queue_insert_list' once enough of them are
+ * buffered, once the oldest one is too old, or when flushed explicitly.
+ * A handle belongs to one producer, e.g. a thread-local variable.
+ *
+ * The number of nodes buffered before publishing adapts to the
+ * consumer. If a batch is published into a queue that the consumer had
+ * drained, the consumer keeps up and batching only adds latency: the
+ * limit is halved. Otherwise the consumer is behind, because of
+ * contention or load, and larger batches save exchanges on the head:
+ * the limit is doubled.
+ *
+ * Nodes are not visible to the consumer while buffered. A producer
+ * going idle must call 'mpsc_queue_batch_flush', or regularly
+ * 'mpsc_queue_batch_flush_expired'.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "mpsc-queue.h"
+
+struct mpsc_queue_batch {
+    struct mpsc_queue *queue;
+    struct mpsc_queue_node *first;
+    struct mpsc_queue_node *last;
+    size_t n_nodes;
+    /* Current threshold, between 1 and 'max_limit'. */
+    size_t limit;
+    size_t max_limit;
+    /* Maximum time a node is buffered, 0 to disable. */
+    long long int max_delay_ns;
+    /* Time at which the first buffered node was inserted. */
+    long long int opened_ns;
+};
+
+/* Producer API. */
+
+/* If 'max_delay_ns' is not 0, each insertion reads the clock. */
+static inline
+void mpsc_queue_batch_init(struct mpsc_queue_batch *batch,
+                           struct mpsc_queue *queue,
+                           size_t max_limit,
+                           long long int max_delay_ns);
+
+/* Buffer a node, publishing the batch if a limit is reached.
+ * Returns 'true' if a batch was published in a drained queue,
+ * like 'mpsc_queue_insert'. */
+static inline
+bool mpsc_queue_batch_insert(struct mpsc_queue_batch *batch,
+                             struct mpsc_queue_node *node);
+
+/* Publish all buffered nodes. */
+static inline
+bool mpsc_queue_batch_flush(struct mpsc_queue_batch *batch);
+
+/* Publish buffered nodes only if the oldest one exceeded its delay. */
+static inline
+bool mpsc_queue_batch_flush_expired(struct mpsc_queue_batch *batch);
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+static inline long long int
+mpsc_queue_batch_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long int) ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+static inline void
+mpsc_queue_batch_init(struct mpsc_queue_batch *batch,
+                      struct mpsc_queue *queue,
+                      size_t max_limit,
+                      long long int max_delay_ns)
+{
+    batch->queue = queue;
+    batch->first = NULL;
+    batch->last = NULL;
+    batch->n_nodes = 0;
+    batch->limit = 1;
+    batch->max_limit = max_limit ? max_limit : 1;
+    batch->max_delay_ns = max_delay_ns;
+    batch->opened_ns = 0;
+}
+
+static inline bool
+mpsc_queue_batch_flush(struct mpsc_queue_batch *batch)
+{
+    bool was_empty;
+
+    if (batch->n_nodes == 0) {
+        return false;
+    }
+
+    was_empty = mpsc_queue_insert_list(batch->queue,
+                                       batch->first, batch->last);
+    batch->first = NULL;
+    batch->last = NULL;
+    batch->n_nodes = 0;
+
+    if (was_empty) {
+        if (batch->limit > 1) {
+            batch->limit /= 2;
+        }
+    } else if (batch->limit < batch->max_limit) {
+        batch->limit *= 2;
+        if (batch->limit > batch->max_limit) {
+            batch->limit = batch->max_limit;
+        }
+    }
+
+    return was_empty;
+}
+
+static inline bool
+mpsc_queue_batch_expired(struct mpsc_queue_batch *batch, long long int now)
+{
+    return batch->max_delay_ns != 0 && batch->n_nodes != 0 &&
+           now - batch->opened_ns >= batch->max_delay_ns;
+}
+
+static inline bool
+mpsc_queue_batch_insert(struct mpsc_queue_batch *batch,
+                        struct mpsc_queue_node *node)
+{
+    long long int now = 0;
+
+    if (batch->max_delay_ns != 0) {
+        now = mpsc_queue_batch_now();
+    }
+
+    if (batch->n_nodes == 0) {
+        batch->first = node;
+        batch->opened_ns = now;
+    } else {
+        atomic_store_explicit(&batch->last->next, node, memory_order_relaxed);
+    }
+    batch->last = node;
+    batch->n_nodes++;
+
+    if (batch->n_nodes >= batch->limit ||
+        mpsc_queue_batch_expired(batch, now)) {
+        return mpsc_queue_batch_flush(batch);
+    }
+    return false;
+}
+
+static inline bool
+mpsc_queue_batch_flush_expired(struct mpsc_queue_batch *batch)
+{
+    if (mpsc_queue_batch_expired(batch, mpsc_queue_batch_now())) {
+        return mpsc_queue_batch_flush(batch);
+    }
+    return false;
+}
+
+#endif /* MPSC_QUEUE_BATCH_H */
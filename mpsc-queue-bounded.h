@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+#ifndef MPSC_QUEUE_BOUNDED_H
+#define MPSC_QUEUE_BOUNDED_H
+
+/* Bounded variant of 'mpsc-queue.h'.
+ *
+ * The queue holds at most 'capacity' nodes. Each insertion consumes a
+ * credit, given back by the consumer once the node is removed.
+ *
+ * Credits are kept in a shared pool. Producers take them in chunks and
+ * cache them in their own handle, so the pool is touched once per
+ * chunk and the insertion itself remains a single exchange. The
+ * consumer also returns credits in chunks. As a consequence, a queue
+ * can refuse an insertion while some credits are cached by idle
+ * producers: 'mpsc_queue_producer_flush' gives them back.
+ *
+ * Each producer can additionally be limited to a quota of nodes present
+ * in the queue at once, so that one producer cannot take the whole
+ * capacity. The consumer counts removed nodes per producer, which the
+ * producer reads only when its quota seems exhausted.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "mpsc-queue.h"
+
+struct mpsc_queue_producer;
+
+struct mpsc_queue_bounded_node {
+    struct mpsc_queue_node node;
+    struct mpsc_queue_producer *producer;
+};
+
+struct mpsc_queue_bounded {
+    struct mpsc_queue queue;
+    /* Credits not held by a producer nor by a node in the queue. */
+    _Atomic(size_t) credits;
+    size_t capacity;
+    /* Number of credits moved at once from or to the pool. */
+    size_t chunk;
+    /* Consumer-owned: credits not yet returned to the pool. */
+    size_t released;
+};
+
+struct mpsc_queue_producer {
+    struct mpsc_queue_bounded *queue;
+    /* Producer-owned. */
+    size_t credits;
+    size_t quota;
+    size_t n_inserted;
+    size_t n_removed_seen;
+    /* Written by the consumer only. */
+    _Atomic(size_t) n_removed;
+};
+
+/* Producer API. */
+
+/* A 'quota' of 0 means that the producer is only limited by
+ * the queue capacity. */
+static inline
+void mpsc_queue_producer_init(struct mpsc_queue_producer *producer,
+                              struct mpsc_queue_bounded *queue,
+                              size_t quota);
+
+/* Return the credits cached by the producer to the queue. */
+static inline
+void mpsc_queue_producer_flush(struct mpsc_queue_producer *producer);
+
+/* Insert a node if the queue has room for it and the producer
+ * is within its quota. Returns 'false' otherwise. */
+static inline
+bool mpsc_queue_try_insert(struct mpsc_queue_producer *producer,
+                           struct mpsc_queue_bounded_node *node);
+
+/* Insert all nodes at once, or none of them. */
+static inline
+bool mpsc_queue_try_insert_batch(struct mpsc_queue_producer *producer,
+                                 size_t n_nodes,
+                                 struct mpsc_queue_bounded_node *nodes[n_nodes]);
+
+/* Consumer API. */
+
+static inline
+void mpsc_queue_bounded_init(struct mpsc_queue_bounded *queue,
+                             size_t capacity);
+
+/* Give back the credit of a node removed from 'queue->queue'.
+ * 'mpsc_queue_bounded_pop' does it already. */
+static inline
+void mpsc_queue_bounded_release(struct mpsc_queue_bounded *queue,
+                                struct mpsc_queue_bounded_node *node);
+
+/* Return the credits released so far to the pool. */
+static inline
+void mpsc_queue_bounded_flush(struct mpsc_queue_bounded *queue);
+
+static inline
+struct mpsc_queue_bounded_node *
+mpsc_queue_bounded_pop(struct mpsc_queue_bounded *queue);
+
+static inline
+bool mpsc_queue_bounded_is_empty(struct mpsc_queue_bounded *queue);
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+#define MPSC_QUEUE_BOUNDED_MAX_CHUNK 64
+
+/* Producer API. */
+
+static inline void
+mpsc_queue_producer_init(struct mpsc_queue_producer *producer,
+                         struct mpsc_queue_bounded *queue,
+                         size_t quota)
+{
+    producer->queue = queue;
+    producer->credits = 0;
+    producer->quota = quota;
+    producer->n_inserted = 0;
+    producer->n_removed_seen = 0;
+    atomic_store_explicit(&producer->n_removed, 0, memory_order_relaxed);
+}
+
+static inline void
+mpsc_queue_producer_flush(struct mpsc_queue_producer *producer)
+{
+    if (producer->credits > 0) {
+        atomic_fetch_add_explicit(&producer->queue->credits,
+                                  producer->credits, memory_order_relaxed);
+        producer->credits = 0;
+    }
+}
+
+/* Make sure the producer holds at least 'n' credits. */
+static inline bool
+mpsc_queue_producer_reserve(struct mpsc_queue_producer *producer, size_t n)
+{
+    struct mpsc_queue_bounded *queue = producer->queue;
+    size_t avail;
+    size_t take;
+
+    if (producer->credits >= n) {
+        return true;
+    }
+
+    avail = atomic_load_explicit(&queue->credits, memory_order_relaxed);
+    do {
+        take = n - producer->credits;
+        if (take < queue->chunk) {
+            take = queue->chunk;
+        }
+        if (take > avail) {
+            take = avail;
+        }
+        if (producer->credits + take < n) {
+            /* Do not hoard a partial reservation: other producers
+             * could otherwise all wait on each other. */
+            mpsc_queue_producer_flush(producer);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&queue->credits,
+                                                    &avail, avail - take,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+    producer->credits += take;
+    return true;
+}
+
+static inline bool
+mpsc_queue_producer_within_quota(struct mpsc_queue_producer *producer,
+                                 size_t n)
+{
+    if (producer->quota == 0) {
+        return true;
+    }
+    if (producer->n_inserted - producer->n_removed_seen + n
+        <= producer->quota) {
+        return true;
+    }
+    producer->n_removed_seen = atomic_load_explicit(&producer->n_removed,
+                                                    memory_order_relaxed);
+    return producer->n_inserted - producer->n_removed_seen + n
+           <= producer->quota;
+}
+
+static inline bool
+mpsc_queue_try_insert(struct mpsc_queue_producer *producer,
+                      struct mpsc_queue_bounded_node *node)
+{
+    if (!mpsc_queue_producer_within_quota(producer, 1) ||
+        !mpsc_queue_producer_reserve(producer, 1)) {
+        return false;
+    }
+
+    producer->credits--;
+    producer->n_inserted++;
+    node->producer = producer;
+    mpsc_queue_insert(&producer->queue->queue, &node->node);
+    return true;
+}
+
+static inline bool
+mpsc_queue_try_insert_batch(struct mpsc_queue_producer *producer,
+                            size_t n_nodes,
+                            struct mpsc_queue_bounded_node *nodes[n_nodes])
+{
+    size_t i;
+
+    if (n_nodes == 0) {
+        return true;
+    }
+
+    if (!mpsc_queue_producer_within_quota(producer, n_nodes) ||
+        !mpsc_queue_producer_reserve(producer, n_nodes)) {
+        return false;
+    }
+
+    producer->credits -= n_nodes;
+    producer->n_inserted += n_nodes;
+    for (i = 0; i < n_nodes - 1; i++) {
+        nodes[i]->producer = producer;
+        atomic_store_explicit(&nodes[i]->node.next, &nodes[i + 1]->node,
+                              memory_order_relaxed);
+    }
+    nodes[i]->producer = producer;
+    mpsc_queue_insert_list(&producer->queue->queue,
+                           &nodes[0]->node, &nodes[i]->node);
+    return true;
+}
+
+/* Consumer API. */
+
+static inline void
+mpsc_queue_bounded_init(struct mpsc_queue_bounded *queue, size_t capacity)
+{
+    mpsc_queue_init(&queue->queue);
+    atomic_store_explicit(&queue->credits, capacity, memory_order_relaxed);
+    queue->capacity = capacity;
+    queue->chunk = capacity / 16;
+    if (queue->chunk > MPSC_QUEUE_BOUNDED_MAX_CHUNK) {
+        queue->chunk = MPSC_QUEUE_BOUNDED_MAX_CHUNK;
+    } else if (queue->chunk == 0) {
+        queue->chunk = 1;
+    }
+    queue->released = 0;
+}
+
+static inline void
+mpsc_queue_bounded_flush(struct mpsc_queue_bounded *queue)
+{
+    if (queue->released > 0) {
+        atomic_fetch_add_explicit(&queue->credits, queue->released,
+                                  memory_order_relaxed);
+        queue->released = 0;
+    }
+}
+
+static inline void
+mpsc_queue_bounded_release(struct mpsc_queue_bounded *queue,
+                           struct mpsc_queue_bounded_node *node)
+{
+    struct mpsc_queue_producer *producer = node->producer;
+    size_t n_removed;
+
+    if (producer->quota != 0) {
+        /* The consumer is the only writer. */
+        n_removed = atomic_load_explicit(&producer->n_removed,
+                                         memory_order_relaxed);
+        atomic_store_explicit(&producer->n_removed, n_removed + 1,
+                              memory_order_relaxed);
+    }
+
+    if (++queue->released >= queue->chunk) {
+        mpsc_queue_bounded_flush(queue);
+    }
+}
+
+static inline struct mpsc_queue_bounded_node *
+mpsc_queue_bounded_pop(struct mpsc_queue_bounded *queue)
+{
+    struct mpsc_queue_bounded_node *node;
+    struct mpsc_queue_node *n;
+
+    n = mpsc_queue_pop(&queue->queue);
+    if (n == NULL) {
+        /* Do not keep credits while producers may be waiting. */
+        mpsc_queue_bounded_flush(queue);
+        return NULL;
+    }
+
+    node = (struct mpsc_queue_bounded_node *) (void *)
+           ((char *) n - offsetof(struct mpsc_queue_bounded_node, node));
+    mpsc_queue_bounded_release(queue, node);
+    return node;
+}
+
+static inline bool
+mpsc_queue_bounded_is_empty(struct mpsc_queue_bounded *queue)
+{
+    return mpsc_queue_is_empty(&queue->queue);
+}
+
+#endif /* MPSC_QUEUE_BOUNDED_H */
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+#ifndef MPSC_QUEUE_POOL_H
+#define MPSC_QUEUE_POOL_H
+
+/* Per-producer node pools for 'mpsc-queue.h'.
+ *
+ * When producers allocate messages and the consumer frees them, every
+ * free is a remote one for the allocator. Instead, each producer owns a
+ * pool of objects. The consumer gives processed objects back to their
+ * pool, in batches, through a return channel that is itself an MPSC
+ * queue. The producer takes all returned objects at once when its free
+ * list runs empty, and only allocates when both are empty.
+ *
+ * Once the pools hold enough objects for the messages in flight,
+ * messages are passed without any allocation.
+ *
+ * Objects embed a 'struct mpsc_queue_pool_node', at the offset given
+ * when initializing the pool. Its queue node can be used to insert the
+ * object in any queue, as long as it is removed before being released.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "mpsc-queue.h"
+
+struct mpsc_queue_pool;
+
+struct mpsc_queue_pool_node {
+    struct mpsc_queue_node node;
+    struct mpsc_queue_pool *pool;
+};
+
+/* The producer, the return channel and the consumer each have their own
+ * cache line: dynamic allocations must respect the alignment of the pool,
+ * e.g. with 'aligned_alloc'. */
+struct mpsc_queue_pool {
+    /* Producer-owned. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) struct mpsc_queue_chain free;
+    size_t obj_size;
+    size_t node_offset;
+    size_t n_allocated;
+    /* Return channel, from the consumer to the producer. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) struct mpsc_queue returns;
+    /* Consumer-owned: nodes not yet sent back. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    struct mpsc_queue_node *pending_first;
+    struct mpsc_queue_node *pending_last;
+    size_t n_pending;
+    bool dirty;
+    struct mpsc_queue_pool *next_dirty;
+};
+
+/* Consumer-side state, tracking the pools with pending nodes. */
+struct mpsc_queue_pool_recycler {
+    struct mpsc_queue_pool *dirty;
+    /* Number of nodes sent back at once. */
+    size_t batch;
+};
+
+/* Producer API. */
+
+static inline
+void mpsc_queue_pool_init(struct mpsc_queue_pool *pool,
+                          size_t obj_size, size_t node_offset);
+
+/* Free all objects in the pool. No object can be in use anymore,
+ * and no node can be pending in a recycler. */
+static inline
+void mpsc_queue_pool_destroy(struct mpsc_queue_pool *pool);
+
+/* Get an object from the pool, allocating it if none is available.
+ * Returns NULL if the allocation failed. */
+static inline
+struct mpsc_queue_pool_node *
+mpsc_queue_pool_get(struct mpsc_queue_pool *pool);
+
+/* Consumer API. */
+
+static inline
+void mpsc_queue_pool_recycler_init(struct mpsc_queue_pool_recycler *recycler,
+                                   size_t batch);
+
+/* Give an object back to its pool.
+ * It is sent back once 'batch' nodes are pending for this pool. */
+static inline
+void mpsc_queue_pool_put(struct mpsc_queue_pool_recycler *recycler,
+                         struct mpsc_queue_pool_node *pnode);
+
+/* Send back all pending nodes, e.g. when the consumer becomes idle. */
+static inline
+void mpsc_queue_pool_recycler_flush(struct mpsc_queue_pool_recycler *recycler);
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+static inline void *
+mpsc_queue_pool_obj(struct mpsc_queue_pool *pool,
+                    struct mpsc_queue_pool_node *pnode)
+{
+    return (char *) pnode - pool->node_offset;
+}
+
+/* Producer API. */
+
+static inline void
+mpsc_queue_pool_init(struct mpsc_queue_pool *pool,
+                     size_t obj_size, size_t node_offset)
+{
+    pool->free.first = NULL;
+    pool->free.last = NULL;
+    pool->obj_size = obj_size;
+    pool->node_offset = node_offset;
+    pool->n_allocated = 0;
+    mpsc_queue_init(&pool->returns);
+    pool->pending_first = NULL;
+    pool->pending_last = NULL;
+    pool->n_pending = 0;
+    pool->dirty = false;
+    pool->next_dirty = NULL;
+}
+
+static inline void
+mpsc_queue_pool_destroy(struct mpsc_queue_pool *pool)
+{
+    struct mpsc_queue_node *node;
+
+    for (;;) {
+        if (pool->free.first == NULL) {
+            pool->free = mpsc_queue_take_all(&pool->returns);
+        }
+        node = mpsc_queue_chain_pop(&pool->free);
+        if (node == NULL) {
+            break;
+        }
+        free(mpsc_queue_pool_obj(pool, (struct mpsc_queue_pool_node *)
+                                       (void *) node));
+    }
+}
+
+static inline struct mpsc_queue_pool_node *
+mpsc_queue_pool_get(struct mpsc_queue_pool *pool)
+{
+    struct mpsc_queue_pool_node *pnode;
+    struct mpsc_queue_node *node;
+    void *obj;
+
+    if (pool->free.first == NULL) {
+        pool->free = mpsc_queue_take_all(&pool->returns);
+    }
+
+    node = mpsc_queue_chain_pop(&pool->free);
+    if (node != NULL) {
+        return (struct mpsc_queue_pool_node *) (void *) node;
+    }
+
+    obj = malloc(pool->obj_size);
+    if (obj == NULL) {
+        return NULL;
+    }
+    pool->n_allocated++;
+
+    pnode = (struct mpsc_queue_pool_node *) (void *)
+            ((char *) obj + pool->node_offset);
+    pnode->pool = pool;
+    return pnode;
+}
+
+/* Consumer API. */
+
+static inline void
+mpsc_queue_pool_recycler_init(struct mpsc_queue_pool_recycler *recycler,
+                              size_t batch)
+{
+    recycler->dirty = NULL;
+    recycler->batch = batch ? batch : 1;
+}
+
+static inline void
+mpsc_queue_pool_send_back(struct mpsc_queue_pool *pool)
+{
+    mpsc_queue_insert_list(&pool->returns,
+                           pool->pending_first, pool->pending_last);
+    pool->pending_first = NULL;
+    pool->pending_last = NULL;
+    pool->n_pending = 0;
+}
+
+static inline void
+mpsc_queue_pool_put(struct mpsc_queue_pool_recycler *recycler,
+                    struct mpsc_queue_pool_node *pnode)
+{
+    struct mpsc_queue_pool *pool = pnode->pool;
+    struct mpsc_queue_node *node = &pnode->node;
+
+    if (pool->n_pending == 0) {
+        pool->pending_first = node;
+    } else {
+        atomic_store_explicit(&pool->pending_last->next, node,
+                              memory_order_relaxed);
+    }
+    pool->pending_last = node;
+    pool->n_pending++;
+
+    /* Once sent back, the pool stays in the dirty list until the next
+     * flush, which skips it if it has nothing pending anymore. */
+    if (!pool->dirty) {
+        pool->dirty = true;
+        pool->next_dirty = recycler->dirty;
+        recycler->dirty = pool;
+    }
+    if (pool->n_pending >= recycler->batch) {
+        mpsc_queue_pool_send_back(pool);
+    }
+}
+
+static inline void
+mpsc_queue_pool_recycler_flush(struct mpsc_queue_pool_recycler *recycler)
+{
+    struct mpsc_queue_pool *pool = recycler->dirty;
+    struct mpsc_queue_pool *next;
+
+    while (pool != NULL) {
+        next = pool->next_dirty;
+        pool->next_dirty = NULL;
+        pool->dirty = false;
+        if (pool->n_pending > 0) {
+            mpsc_queue_pool_send_back(pool);
+        }
+        pool = next;
+    }
+    recycler->dirty = NULL;
+}
+
+#endif /* MPSC_QUEUE_POOL_H */
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+#ifndef MPSC_QUEUE_STATS_H
+#define MPSC_QUEUE_STATS_H
+
+/* Reading the counters of 'mpsc-queue.h'.
+ *
+ * Counters are only maintained if MPSC_QUEUE_STATS is defined before
+ * including 'mpsc-queue.h', in every compilation unit using the queue,
+ * e.g. with -DMPSC_QUEUE_STATS.
+ *
+ * A snapshot can be taken from any thread, while the queue is in use.
+ * Each counter is read atomically, but the snapshot as a whole is not:
+ * counters can be slightly out of sync with each other.
+ */
+
+#ifndef MPSC_QUEUE_STATS
+#error "MPSC_QUEUE_STATS must be defined to use queue statistics."
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "mpsc-queue.h"
+
+struct mpsc_queue_stats {
+    /* Producers. */
+    uint64_t inserts;
+    uint64_t batches;
+    uint64_t batch_nodes;
+    uint64_t batch_sizes[MPSC_QUEUE_STATS_BATCH_BUCKETS];
+    /* Consumer. */
+    uint64_t polls;
+    uint64_t items;
+    uint64_t empty;
+    uint64_t retries;
+    uint64_t stub_inserts;
+};
+
+static inline
+void mpsc_queue_stats_get(struct mpsc_queue *queue,
+                          struct mpsc_queue_stats *stats);
+
+/* Write the statistics of 'n' queues in the Prometheus text format,
+ * labelled with their name. Returns a negative value on error. */
+static inline
+int mpsc_queue_stats_dump_prometheus(FILE *stream, size_t n,
+                                     const char *names[n],
+                                     const struct mpsc_queue_stats stats[n]);
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+static inline uint64_t
+mpsc_queue_stats_read(_Atomic(uint64_t) *counter)
+{
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static inline void
+mpsc_queue_stats_get(struct mpsc_queue *queue,
+                     struct mpsc_queue_stats *stats)
+{
+    struct mpsc_queue_consumer_stats *cs = &queue->consumer_stats;
+
+    *stats = (struct mpsc_queue_stats) { 0 };
+
+    for (size_t i = 0; i < MPSC_QUEUE_STATS_SHARDS; i++) {
+        struct mpsc_queue_stats_shard *shard = &queue->stats[i];
+
+        stats->inserts += mpsc_queue_stats_read(&shard->inserts);
+        stats->batch_nodes += mpsc_queue_stats_read(&shard->batch_nodes);
+        for (size_t j = 0; j < MPSC_QUEUE_STATS_BATCH_BUCKETS; j++) {
+            uint64_t n = mpsc_queue_stats_read(&shard->batch_sizes[j]);
+
+            stats->batch_sizes[j] += n;
+            stats->batches += n;
+        }
+    }
+
+    stats->polls = mpsc_queue_stats_read(&cs->polls);
+    stats->items = mpsc_queue_stats_read(&cs->items);
+    stats->empty = mpsc_queue_stats_read(&cs->empty);
+    stats->retries = mpsc_queue_stats_read(&cs->retries);
+    stats->stub_inserts = mpsc_queue_stats_read(&cs->stub_inserts);
+}
+
+static inline int
+mpsc_queue_stats_dump_prometheus(FILE *stream, size_t n,
+                                 const char *names[n],
+                                 const struct mpsc_queue_stats stats[n])
+{
+    static const struct {
+        const char *name;
+        const char *help;
+        size_t offset;
+    } counters[] = {
+#define MPSC_QUEUE_STATS_COUNTER(FIELD, HELP) \
+        { #FIELD, HELP, offsetof(struct mpsc_queue_stats, FIELD) }
+        MPSC_QUEUE_STATS_COUNTER(inserts, "Insertions in the queue."),
+        MPSC_QUEUE_STATS_COUNTER(polls, "Polls of the queue."),
+        MPSC_QUEUE_STATS_COUNTER(items, "Nodes removed from the queue."),
+        MPSC_QUEUE_STATS_COUNTER(empty, "Polls finding the queue empty."),
+        MPSC_QUEUE_STATS_COUNTER(retries,
+                                 "Polls stopped by an insertion "
+                                 "in progress."),
+        MPSC_QUEUE_STATS_COUNTER(stub_inserts,
+                                 "Stub insertions by the consumer."),
+#undef MPSC_QUEUE_STATS_COUNTER
+    };
+    int err = 0;
+
+    for (size_t i = 0; i < sizeof counters / sizeof counters[0]; i++) {
+        err |= fprintf(stream, "# HELP mpsc_queue_%s_total %s\n"
+                       "# TYPE mpsc_queue_%s_total counter\n",
+                       counters[i].name, counters[i].help,
+                       counters[i].name) < 0;
+        for (size_t q = 0; q < n; q++) {
+            const uint64_t *value = (const void *)
+                ((const char *) &stats[q] + counters[i].offset);
+
+            err |= fprintf(stream,
+                           "mpsc_queue_%s_total{queue=\"%s\"} %" PRIu64 "\n",
+                           counters[i].name, names[q], *value) < 0;
+        }
+    }
+
+    /* Buckets are cumulative, bounded by the largest size they hold. */
+    err |= fprintf(stream, "# HELP mpsc_queue_batch_size "
+                   "Number of nodes in batch insertions.\n"
+                   "# TYPE mpsc_queue_batch_size histogram\n") < 0;
+    for (size_t q = 0; q < n; q++) {
+        uint64_t count = 0;
+
+        for (size_t j = 0; j < MPSC_QUEUE_STATS_BATCH_BUCKETS - 1; j++) {
+            count += stats[q].batch_sizes[j];
+            err |= fprintf(stream, "mpsc_queue_batch_size_bucket"
+                           "{queue=\"%s\",le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+                           names[q], (UINT64_C(2) << j) - 1, count) < 0;
+        }
+        err |= fprintf(stream, "mpsc_queue_batch_size_bucket"
+                       "{queue=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+                       "mpsc_queue_batch_size_sum{queue=\"%s\"} %" PRIu64 "\n"
+                       "mpsc_queue_batch_size_count{queue=\"%s\"} %" PRIu64
+                       "\n",
+                       names[q], stats[q].batches,
+                       names[q], stats[q].batch_nodes,
+                       names[q], stats[q].batches) < 0;
+    }
+
+    return err ? -1 : 0;
+}
+
+#endif /* MPSC_QUEUE_STATS_H */
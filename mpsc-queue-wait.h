@@ -0,0 +1,328 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+#ifndef MPSC_QUEUE_WAIT_H
+#define MPSC_QUEUE_WAIT_H
+
+/* Blocking consumer for 'mpsc-queue.h'.
+ *
+ * The consumer waits for nodes following a wait strategy: it spins
+ * first, then yields its CPU, then parks in the kernel. Parking uses a
+ * futex on Linux. On other systems, parking falls back to yielding.
+ *
+ * Producers only need to notify the waiter when their insertion
+ * returned 'true', i.e. once per drain of the queue. If the consumer
+ * is not parked, the notification costs a fence and a load, and no
+ * system call is made.
+ *
+ * This does not apply to a 'struct mpsc_queue_consumer': while it holds
+ * its last node, insertions return 'false' and it is never notified.
+ * It must release its held node before waiting.
+ *
+ * On Linux, a consumer running an event loop can instead be notified
+ * through an eventfd. As producers only signal it on the first
+ * insertion after a drain, a burst of insertions costs a single write.
+ * The consumer must clear the notifier before draining the queue, and
+ * drain it until it is empty, not merely until a retry.
+ *
+ * On Linux, the 'syscall' function must be declared:
+ * define _GNU_SOURCE or _DEFAULT_SOURCE before including this header.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "mpsc-queue.h"
+
+enum mpsc_queue_wait_strategy {
+    /* Busy-poll the queue, never give up the CPU. */
+    MPSC_QUEUE_WAIT_SPIN,
+    /* Spin for a while, then yield the CPU between polls. */
+    MPSC_QUEUE_WAIT_YIELD,
+    /* Spin, yield, then sleep until a producer wakes the consumer. */
+    MPSC_QUEUE_WAIT_PARK,
+};
+
+#define MPSC_QUEUE_WAIT_SPIN_LIMIT 100
+#define MPSC_QUEUE_WAIT_YIELD_LIMIT 10
+
+struct mpsc_queue_waiter {
+    /* Futex word, MPSC_QUEUE_WAITER_PARKED while the consumer sleeps. */
+    _Atomic(uint32_t) state;
+    enum mpsc_queue_wait_strategy strategy;
+    /* Number of empty polls before yielding. */
+    unsigned int spin_limit;
+    /* Number of yields before parking. */
+    unsigned int yield_limit;
+};
+
+enum {
+    MPSC_QUEUE_WAITER_AWAKE,
+    MPSC_QUEUE_WAITER_PARKED,
+};
+
+/* Producer API. */
+
+/* Wake the consumer if it is parked.
+ * Call it after any insertion that returned 'true'. No insertion does
+ * while a 'struct mpsc_queue_consumer' holds its last node. */
+static inline
+void mpsc_queue_waiter_wake(struct mpsc_queue_waiter *waiter);
+
+/* Consumer API. */
+
+static inline
+void mpsc_queue_waiter_init(struct mpsc_queue_waiter *waiter,
+                            enum mpsc_queue_wait_strategy strategy);
+
+/* Remove a node from the queue, waiting for one if it is empty.
+ * 'deadline' is an absolute CLOCK_MONOTONIC time, or NULL to wait
+ * forever. Returns NULL if the deadline is reached. */
+static inline
+struct mpsc_queue_node *
+mpsc_queue_pop_wait(struct mpsc_queue *queue,
+                    struct mpsc_queue_waiter *waiter,
+                    const struct timespec *deadline);
+
+#ifdef __linux__
+struct mpsc_queue_notifier {
+    int fd;
+};
+
+/* Producer API. */
+
+/* Signal the eventfd.
+ * Call it after any insertion that returned 'true'. */
+static inline
+void mpsc_queue_notify(struct mpsc_queue_notifier *notifier);
+
+/* Consumer API. */
+
+/* Create a non-blocking eventfd.
+ * Returns 0 on success, a negative errno value otherwise. */
+static inline
+int mpsc_queue_notifier_init(struct mpsc_queue_notifier *notifier);
+
+static inline
+void mpsc_queue_notifier_destroy(struct mpsc_queue_notifier *notifier);
+
+/* Consume pending signals, returning their number.
+ * Call it before draining the queue. */
+static inline
+uint64_t mpsc_queue_notifier_clear(struct mpsc_queue_notifier *notifier);
+#endif
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+static inline void
+mpsc_queue_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+#ifdef __linux__
+static inline void
+mpsc_queue_futex_wait(_Atomic(uint32_t) *addr, uint32_t val,
+                      const struct timespec *deadline)
+{
+    /* With FUTEX_WAIT_BITSET, the timeout is absolute on CLOCK_MONOTONIC. */
+    syscall(SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE, val, deadline,
+            NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static inline void
+mpsc_queue_futex_wake(_Atomic(uint32_t) *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+/* Producer API. */
+
+static inline void
+mpsc_queue_waiter_wake(struct mpsc_queue_waiter *waiter)
+{
+    /* Pairs with the fence in 'mpsc_queue_park': either the consumer
+     * sees the insertion, or this load sees the consumer parking. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&waiter->state, memory_order_relaxed)
+        == MPSC_QUEUE_WAITER_AWAKE) {
+        return;
+    }
+    if (atomic_exchange_explicit(&waiter->state, MPSC_QUEUE_WAITER_AWAKE,
+                                 memory_order_relaxed)
+        == MPSC_QUEUE_WAITER_PARKED) {
+#ifdef __linux__
+        mpsc_queue_futex_wake(&waiter->state);
+#endif
+    }
+}
+
+/* Consumer API. */
+
+static inline void
+mpsc_queue_waiter_init(struct mpsc_queue_waiter *waiter,
+                       enum mpsc_queue_wait_strategy strategy)
+{
+    atomic_store_explicit(&waiter->state, MPSC_QUEUE_WAITER_AWAKE,
+                          memory_order_relaxed);
+    waiter->strategy = strategy;
+    waiter->spin_limit = MPSC_QUEUE_WAIT_SPIN_LIMIT;
+    waiter->yield_limit = MPSC_QUEUE_WAIT_YIELD_LIMIT;
+}
+
+static inline bool
+mpsc_queue_deadline_passed(const struct timespec *deadline)
+{
+    struct timespec now;
+
+    if (deadline == NULL) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec ||
+           (now.tv_sec == deadline->tv_sec &&
+            now.tv_nsec >= deadline->tv_nsec);
+}
+
+/* Sleep until woken up by a producer, unless the queue
+ * received a node in the meantime. */
+static inline void
+mpsc_queue_park(struct mpsc_queue *queue,
+                struct mpsc_queue_waiter *waiter,
+                const struct timespec *deadline)
+{
+#ifdef __linux__
+    atomic_store_explicit(&waiter->state, MPSC_QUEUE_WAITER_PARKED,
+                          memory_order_relaxed);
+    /* Pairs with the fence in 'mpsc_queue_waiter_wake'. */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (mpsc_queue_is_empty(queue)) {
+        mpsc_queue_futex_wait(&waiter->state, MPSC_QUEUE_WAITER_PARKED,
+                              deadline);
+    }
+    atomic_store_explicit(&waiter->state, MPSC_QUEUE_WAITER_AWAKE,
+                          memory_order_relaxed);
+#else
+    (void) queue;
+    (void) waiter;
+    (void) deadline;
+    sched_yield();
+#endif
+}
+
+static inline struct mpsc_queue_node *
+mpsc_queue_pop_wait(struct mpsc_queue *queue,
+                    struct mpsc_queue_waiter *waiter,
+                    const struct timespec *deadline)
+{
+    enum mpsc_queue_poll_result result;
+    struct mpsc_queue_node *node;
+    unsigned int n_empty = 0;
+
+    for (;;) {
+        result = mpsc_queue_poll(queue, &node);
+        if (result == MPSC_QUEUE_ITEM) {
+            return node;
+        }
+        if (result == MPSC_QUEUE_RETRY) {
+            /* A producer is finishing its insertion, never sleep. */
+            mpsc_queue_cpu_relax();
+            continue;
+        }
+
+        if (mpsc_queue_deadline_passed(deadline)) {
+            return NULL;
+        }
+
+        if (waiter->strategy == MPSC_QUEUE_WAIT_SPIN ||
+            n_empty < waiter->spin_limit) {
+            mpsc_queue_cpu_relax();
+        } else if (waiter->strategy == MPSC_QUEUE_WAIT_YIELD ||
+                   n_empty < waiter->spin_limit + waiter->yield_limit) {
+            sched_yield();
+        } else {
+            /* Do not count further, after a spurious wake-up
+             * the consumer parks again right away. */
+            mpsc_queue_park(queue, waiter, deadline);
+            continue;
+        }
+        n_empty++;
+    }
+}
+
+#ifdef __linux__
+
+/* Producer API. */
+
+static inline void
+mpsc_queue_notify(struct mpsc_queue_notifier *notifier)
+{
+    uint64_t one = 1;
+    ssize_t ret;
+
+    /* The counter cannot realistically overflow, so EAGAIN is not
+     * expected. Interrupted writes are retried. */
+    do {
+        ret = write(notifier->fd, &one, sizeof one);
+    } while (ret < 0 && errno == EINTR);
+}
+
+/* Consumer API. */
+
+static inline int
+mpsc_queue_notifier_init(struct mpsc_queue_notifier *notifier)
+{
+    notifier->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notifier->fd < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static inline void
+mpsc_queue_notifier_destroy(struct mpsc_queue_notifier *notifier)
+{
+    if (notifier->fd >= 0) {
+        close(notifier->fd);
+        notifier->fd = -1;
+    }
+}
+
+static inline uint64_t
+mpsc_queue_notifier_clear(struct mpsc_queue_notifier *notifier)
+{
+    uint64_t count;
+    ssize_t ret;
+
+    do {
+        ret = read(notifier->fd, &count, sizeof count);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret == sizeof count ? count : 0;
+}
+
+#endif /* __linux__ */
+
+#endif /* MPSC_QUEUE_WAIT_H */
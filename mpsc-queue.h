@@ -13,22 +13,85 @@ struct mpsc_queue_node {
     _Atomic(struct mpsc_queue_node *) next;
 };
 
+/* By default, the queue is kept compact and all its fields share a cache
+ * line: each insertion then invalidates the line read by the consumer.
+ * Define MPSC_QUEUE_CACHE_ALIGNED before including this header to place
+ * the producers' 'head' and the consumer's 'tail' on separate lines.
+ * The queue is then aligned on MPSC_QUEUE_CACHE_LINE_SIZE, which dynamic
+ * allocations must respect, e.g. with 'aligned_alloc'. */
+#ifndef MPSC_QUEUE_CACHE_LINE_SIZE
+#define MPSC_QUEUE_CACHE_LINE_SIZE 64
+#endif
+
+#ifdef MPSC_QUEUE_CACHE_ALIGNED
+#define MPSC_QUEUE_ALIGNED _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+#else
+#define MPSC_QUEUE_ALIGNED
+#endif
+
+/* Define MPSC_QUEUE_STATS before including this header to count the
+ * queue operations. Use 'mpsc-queue-stats.h' to read the counters.
+ * Without it, the queue has no counter and the operations no overhead. */
+#ifdef MPSC_QUEUE_STATS
+#include <stdint.h>
+
+#ifndef MPSC_QUEUE_STATS_SHARDS
+#define MPSC_QUEUE_STATS_SHARDS 16
+#endif
+
+/* Batch sizes are counted in power-of-two buckets: 1, 2-3, 4-7, ...
+ * The last bucket counts all larger batches. */
+#define MPSC_QUEUE_STATS_BATCH_BUCKETS 8
+
+/* Producer counters. Each thread uses its own shard,
+ * unless there are more threads than shards. */
+struct mpsc_queue_stats_shard {
+    /* Exchanges on 'head', whatever the number of nodes. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) _Atomic(uint64_t) inserts;
+    /* Nodes inserted with 'mpsc_queue_insert_batch'. */
+    _Atomic(uint64_t) batch_nodes;
+    _Atomic(uint64_t) batch_sizes[MPSC_QUEUE_STATS_BATCH_BUCKETS];
+};
+
+/* Consumer counters, written by the consumer only. */
+struct mpsc_queue_consumer_stats {
+    _Atomic(uint64_t) polls;
+    _Atomic(uint64_t) items;
+    _Atomic(uint64_t) empty;
+    _Atomic(uint64_t) retries;
+    _Atomic(uint64_t) stub_inserts;
+};
+#endif
+
 struct mpsc_queue {
-    _Atomic(struct mpsc_queue_node *) head;
-    _Atomic(struct mpsc_queue_node *) tail;
+    /* Written by producers. */
+    MPSC_QUEUE_ALIGNED _Atomic(struct mpsc_queue_node *) head;
+    /* Written by the consumer. The stub is written by a producer
+     * only when inserting in a drained queue. */
+    MPSC_QUEUE_ALIGNED _Atomic(struct mpsc_queue_node *) tail;
     struct mpsc_queue_node stub;
+#ifdef MPSC_QUEUE_STATS
+    struct mpsc_queue_consumer_stats consumer_stats;
+    struct mpsc_queue_stats_shard stats[MPSC_QUEUE_STATS_SHARDS];
+#endif
 };
 
 /* Producer API. */
 
+/* All insertions return 'true' if the consumer had drained the queue
+ * before it. Only one producer sees it for each time the queue is
+ * drained, which makes it suitable to wake up a sleeping consumer.
+ * A 'struct mpsc_queue_consumer' holding its last node has not drained
+ * the queue: insertions then return 'false'. */
+
 static inline
-void mpsc_queue_insert(struct mpsc_queue *queue, struct mpsc_queue_node *node);
+bool mpsc_queue_insert(struct mpsc_queue *queue, struct mpsc_queue_node *node);
 
 /* Insert a list of nodes in a single operation.
  * The nodes must all be appropriately linked from
  * first to last. */
 static inline
-void mpsc_queue_insert_list(struct mpsc_queue *queue,
+bool mpsc_queue_insert_list(struct mpsc_queue *queue,
                             struct mpsc_queue_node *first,
                             struct mpsc_queue_node *last);
 
@@ -36,10 +99,27 @@ void mpsc_queue_insert_list(struct mpsc_queue *queue,
  * The nodes will be linked together before
  * being inserted in the queue. */
 static inline
-void mpsc_queue_insert_batch(struct mpsc_queue *queue,
+bool mpsc_queue_insert_batch(struct mpsc_queue *queue,
                              size_t n_nodes,
                              struct mpsc_queue_node *node_ptrs[n_nodes]);
 
+/* Single-producer insertion.
+ * When a single thread inserts in the queue, 'head' is only written by
+ * this thread and is published with a store instead of an exchange.
+ * No other thread can insert concurrently, the consumer included: the
+ * queue must be consumed through a 'struct mpsc_queue_consumer', and its
+ * held node released only while the producer is not inserting.
+ * As the consumer keeps its last node, the return value is 'true' only
+ * for the first insertion or after a release. */
+static inline
+bool mpsc_queue_insert_sp(struct mpsc_queue *queue,
+                          struct mpsc_queue_node *node);
+
+static inline
+bool mpsc_queue_insert_list_sp(struct mpsc_queue *queue,
+                               struct mpsc_queue_node *first,
+                               struct mpsc_queue_node *last);
+
 /* Consumer API. */
 
 #define MPSC_QUEUE_FOR_EACH(node, queue) \
@@ -70,6 +150,87 @@ static inline
 struct mpsc_queue_node *
 mpsc_queue_pop(struct mpsc_queue *queue);
 
+/* Remove up to 'n_nodes' nodes from the queue, writing them in order
+ * in 'nodes'. Returns the number of nodes removed.
+ * Stops early if the queue is empty or if a producer has not
+ * finished its insertion, in which case 'mpsc_queue_poll' can be
+ * used to tell the two apart. */
+static inline
+size_t mpsc_queue_pop_batch(struct mpsc_queue *queue,
+                            size_t n_nodes,
+                            struct mpsc_queue_node *nodes[n_nodes]);
+
+/* A list of nodes detached from a queue.
+ * It belongs to the consumer only. */
+struct mpsc_queue_chain {
+    struct mpsc_queue_node *first;
+    struct mpsc_queue_node *last;
+};
+
+#define MPSC_QUEUE_CHAIN_FOR_EACH_POP(node, chain) \
+    while ((node = mpsc_queue_chain_pop(chain)))
+
+/* Detach all nodes currently in the queue and return them as a chain.
+ * The detach itself is a single atomic exchange. */
+static inline
+struct mpsc_queue_chain mpsc_queue_take_all(struct mpsc_queue *queue);
+
+/* Remove the first node of a chain.
+ * If a producer is still linking this node to the next one,
+ * wait until it is done. */
+static inline
+struct mpsc_queue_node *
+mpsc_queue_chain_pop(struct mpsc_queue_chain *chain);
+
+/* Deferred-release consumption.
+ *
+ * When the consumer removes the last node of the queue, 'mpsc_queue_poll'
+ * inserts the stub back, an exchange on 'head' contended with producers.
+ * A consumer handle instead leaves that last node linked as the tail of
+ * the queue, although it was returned, and holds it. The held node is
+ * released once the consumer moves past it, or when released explicitly,
+ * e.g. before going idle: only then is the stub inserted, and only if no
+ * node was inserted in the meantime.
+ *
+ * As the queue is not drained while a node is held, insertions return
+ * 'false' until a release: the return value is 'true' only for the first
+ * insertion or after a release. A consumer waiting on it must release
+ * its held node before going idle, or it is never woken up.
+ *
+ * A held node must not be inserted again nor freed before its release.
+ * A queue consumed through a handle must not be consumed otherwise. */
+struct mpsc_queue_consumer {
+    struct mpsc_queue *queue;
+    /* Last node returned, still linked as the tail of the queue. */
+    struct mpsc_queue_node *held;
+};
+
+static inline
+void mpsc_queue_consumer_init(struct mpsc_queue_consumer *consumer,
+                              struct mpsc_queue *queue);
+
+/* Same as 'mpsc_queue_poll'. If the held node is released, it is written
+ * in 'released', otherwise NULL is written. */
+static inline
+enum mpsc_queue_poll_result
+mpsc_queue_consumer_poll(struct mpsc_queue_consumer *consumer,
+                         struct mpsc_queue_node **node,
+                         struct mpsc_queue_node **released);
+
+static inline
+struct mpsc_queue_node *
+mpsc_queue_consumer_pop(struct mpsc_queue_consumer *consumer,
+                        struct mpsc_queue_node **released);
+
+/* Release the held node, inserting the stub if it is still the last
+ * node of the queue. Returns the node, or NULL if none was held. */
+static inline
+struct mpsc_queue_node *
+mpsc_queue_consumer_release(struct mpsc_queue_consumer *consumer);
+
+static inline
+bool mpsc_queue_consumer_is_empty(struct mpsc_queue_consumer *consumer);
+
 static inline
 struct mpsc_queue_node *
 mpsc_queue_tail(struct mpsc_queue *queue);
@@ -83,35 +244,153 @@ mpsc_queue_next(struct mpsc_queue *queue,
 /* Implementation. */
 /*******************/
 
-/* Producer API. */
+#ifdef MPSC_QUEUE_STATS
+
+static inline struct mpsc_queue_stats_shard *
+mpsc_queue_stats_shard(struct mpsc_queue *queue)
+{
+    static _Atomic(unsigned int) n_threads;
+    static _Thread_local unsigned int shard_id;
+
+    /* 0 means that the thread has no shard yet. */
+    if (shard_id == 0) {
+        shard_id = atomic_fetch_add_explicit(&n_threads, 1,
+                                             memory_order_relaxed)
+                   % MPSC_QUEUE_STATS_SHARDS + 1;
+    }
+    return &queue->stats[shard_id - 1];
+}
+
+static inline void
+mpsc_queue_stats_add(_Atomic(uint64_t) *counter, uint64_t n)
+{
+    /* Shards can be shared by threads. */
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+/* Consumer counters have a single writer. */
+static inline void
+mpsc_queue_stats_add_single(_Atomic(uint64_t) *counter, uint64_t n)
+{
+    atomic_store_explicit(counter,
+                          atomic_load_explicit(counter, memory_order_relaxed)
+                          + n, memory_order_relaxed);
+}
+
+static inline unsigned int
+mpsc_queue_stats_batch_bucket(size_t n_nodes)
+{
+    unsigned int bucket = 0;
+
+    while (n_nodes > 1 && bucket < MPSC_QUEUE_STATS_BATCH_BUCKETS - 1) {
+        n_nodes >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
 
 static inline void
+mpsc_queue_stats_init(struct mpsc_queue *queue)
+{
+    struct mpsc_queue_consumer_stats *cs = &queue->consumer_stats;
+
+    atomic_store_explicit(&cs->polls, 0, memory_order_relaxed);
+    atomic_store_explicit(&cs->items, 0, memory_order_relaxed);
+    atomic_store_explicit(&cs->empty, 0, memory_order_relaxed);
+    atomic_store_explicit(&cs->retries, 0, memory_order_relaxed);
+    atomic_store_explicit(&cs->stub_inserts, 0, memory_order_relaxed);
+    for (size_t i = 0; i < MPSC_QUEUE_STATS_SHARDS; i++) {
+        struct mpsc_queue_stats_shard *shard = &queue->stats[i];
+
+        atomic_store_explicit(&shard->inserts, 0, memory_order_relaxed);
+        atomic_store_explicit(&shard->batch_nodes, 0, memory_order_relaxed);
+        for (size_t j = 0; j < MPSC_QUEUE_STATS_BATCH_BUCKETS; j++) {
+            atomic_store_explicit(&shard->batch_sizes[j], 0,
+                                  memory_order_relaxed);
+        }
+    }
+}
+
+#define MPSC_QUEUE_STATS_INIT(queue) mpsc_queue_stats_init(queue)
+#define MPSC_QUEUE_STATS_INSERT(queue) \
+    mpsc_queue_stats_add(&mpsc_queue_stats_shard(queue)->inserts, 1)
+#define MPSC_QUEUE_STATS_BATCH(queue, n_nodes) \
+    do { \
+        struct mpsc_queue_stats_shard *shard_ = \
+            mpsc_queue_stats_shard(queue); \
+        mpsc_queue_stats_add(&shard_->batch_nodes, (n_nodes)); \
+        mpsc_queue_stats_add(&shard_->batch_sizes[ \
+            mpsc_queue_stats_batch_bucket(n_nodes)], 1); \
+    } while (0)
+#define MPSC_QUEUE_STATS_CONSUMER(queue, field, n) \
+    mpsc_queue_stats_add_single(&(queue)->consumer_stats.field, (n))
+
+#else
+
+#define MPSC_QUEUE_STATS_INIT(queue) ((void) 0)
+#define MPSC_QUEUE_STATS_INSERT(queue) ((void) 0)
+#define MPSC_QUEUE_STATS_BATCH(queue, n_nodes) ((void) 0)
+#define MPSC_QUEUE_STATS_CONSUMER(queue, field, n) ((void) 0)
+
+#endif /* MPSC_QUEUE_STATS */
+
+/* Poll results, counted by the consumer. */
+static inline enum mpsc_queue_poll_result
+mpsc_queue_stats_poll(struct mpsc_queue *queue,
+                      enum mpsc_queue_poll_result result)
+{
+    MPSC_QUEUE_STATS_CONSUMER(queue, polls, 1);
+    if (result == MPSC_QUEUE_ITEM) {
+        MPSC_QUEUE_STATS_CONSUMER(queue, items, 1);
+    } else if (result == MPSC_QUEUE_EMPTY) {
+        MPSC_QUEUE_STATS_CONSUMER(queue, empty, 1);
+    } else {
+        MPSC_QUEUE_STATS_CONSUMER(queue, retries, 1);
+    }
+    (void) queue;
+    return result;
+}
+
+/* Producer API. */
+
+static inline bool
 mpsc_queue_insert(struct mpsc_queue *queue, struct mpsc_queue_node *node)
 {
-    mpsc_queue_insert_list(queue, node, node);
+    return mpsc_queue_insert_list(queue, node, node);
 }
 
-static inline
-void mpsc_queue_insert_list(struct mpsc_queue *queue,
-                            struct mpsc_queue_node *first,
-                            struct mpsc_queue_node *last)
+static inline bool
+mpsc_queue_insert_list__(struct mpsc_queue *queue,
+                         struct mpsc_queue_node *first,
+                         struct mpsc_queue_node *last)
 {
     struct mpsc_queue_node *prev;
 
     atomic_store_explicit(&last->next, NULL, memory_order_relaxed);
     prev = atomic_exchange_explicit(&queue->head, last, memory_order_acq_rel);
     atomic_store_explicit(&prev->next, first, memory_order_release);
+
+    return prev == &queue->stub;
+}
+
+static inline
+bool mpsc_queue_insert_list(struct mpsc_queue *queue,
+                            struct mpsc_queue_node *first,
+                            struct mpsc_queue_node *last)
+{
+    MPSC_QUEUE_STATS_INSERT(queue);
+    return mpsc_queue_insert_list__(queue, first, last);
 }
 
 static inline
-void mpsc_queue_insert_batch(struct mpsc_queue *queue,
+bool mpsc_queue_insert_batch(struct mpsc_queue *queue,
                              size_t n_nodes,
                              struct mpsc_queue_node *node_ptrs[n_nodes])
 {
     struct mpsc_queue_node *first, *last, *node;
 
     if (n_nodes == 0) {
-        return;
+        return false;
     }
 
     first = node_ptrs[0];
@@ -122,17 +401,69 @@ void mpsc_queue_insert_batch(struct mpsc_queue *queue,
         atomic_store_explicit(&node->next, node_ptrs[i + 1],
                               memory_order_relaxed);
     }
-    mpsc_queue_insert_list(queue, first, last);
+    MPSC_QUEUE_STATS_BATCH(queue, n_nodes);
+    return mpsc_queue_insert_list(queue, first, last);
+}
+
+static inline bool
+mpsc_queue_insert_sp(struct mpsc_queue *queue, struct mpsc_queue_node *node)
+{
+    return mpsc_queue_insert_list_sp(queue, node, node);
+}
+
+static inline bool
+mpsc_queue_insert_list_sp(struct mpsc_queue *queue,
+                          struct mpsc_queue_node *first,
+                          struct mpsc_queue_node *last)
+{
+    struct mpsc_queue_node *prev;
+
+    MPSC_QUEUE_STATS_INSERT(queue);
+    atomic_store_explicit(&last->next, NULL, memory_order_relaxed);
+    /* The producer is the only writer of 'head'. */
+    prev = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, last, memory_order_release);
+    atomic_store_explicit(&prev->next, first, memory_order_release);
+
+    return prev == &queue->stub;
 }
 
 /* Consumer API. */
 
+/* When the consumer moves past the stub, the stub is not part of the
+ * queue anymore until it is inserted again. Mark it by pointing it to
+ * itself, so that 'mpsc_queue_take_all' knows without walking the queue
+ * whether the stub can be reused. Producers never write to the stub
+ * once its next pointer is set. */
+static inline void
+mpsc_queue_stub_unlink(struct mpsc_queue *queue)
+{
+    atomic_store_explicit(&queue->stub.next, &queue->stub,
+                          memory_order_relaxed);
+}
+
+static inline bool
+mpsc_queue_stub_is_linked(struct mpsc_queue *queue)
+{
+    return atomic_load_explicit(&queue->stub.next, memory_order_relaxed)
+           != &queue->stub;
+}
+
+/* Link the stub back after the last node, as the consumer. */
+static inline void
+mpsc_queue_insert_stub(struct mpsc_queue *queue)
+{
+    MPSC_QUEUE_STATS_CONSUMER(queue, stub_inserts, 1);
+    mpsc_queue_insert_list__(queue, &queue->stub, &queue->stub);
+}
+
 static inline void
 mpsc_queue_init(struct mpsc_queue *queue)
 {
     atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
     atomic_store_explicit(&queue->tail, &queue->stub, memory_order_relaxed);
     atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    MPSC_QUEUE_STATS_INIT(queue);
 }
 
 static inline
@@ -162,7 +493,7 @@ mpsc_queue_is_empty(struct mpsc_queue *queue)
 }
 
 static inline enum mpsc_queue_poll_result
-mpsc_queue_poll(struct mpsc_queue *queue, struct mpsc_queue_node **node)
+mpsc_queue_poll__(struct mpsc_queue *queue, struct mpsc_queue_node **node)
 {
     struct mpsc_queue_node *tail;
     struct mpsc_queue_node *next;
@@ -182,6 +513,7 @@ mpsc_queue_poll(struct mpsc_queue *queue, struct mpsc_queue_node **node)
         }
 
         atomic_store_explicit(&queue->tail, next, memory_order_relaxed);
+        mpsc_queue_stub_unlink(queue);
         tail = next;
         next = atomic_load_explicit(&tail->next, memory_order_acquire);
     }
@@ -197,7 +529,7 @@ mpsc_queue_poll(struct mpsc_queue *queue, struct mpsc_queue_node **node)
         return MPSC_QUEUE_RETRY;
     }
 
-    mpsc_queue_insert(queue, &queue->stub);
+    mpsc_queue_insert_stub(queue);
 
     next = atomic_load_explicit(&tail->next, memory_order_acquire);
     if (next != NULL) {
@@ -209,6 +541,12 @@ mpsc_queue_poll(struct mpsc_queue *queue, struct mpsc_queue_node **node)
     return MPSC_QUEUE_RETRY;
 }
 
+static inline enum mpsc_queue_poll_result
+mpsc_queue_poll(struct mpsc_queue *queue, struct mpsc_queue_node **node)
+{
+    return mpsc_queue_stats_poll(queue, mpsc_queue_poll__(queue, node));
+}
+
 static inline
 struct mpsc_queue_node *
 mpsc_queue_pop(struct mpsc_queue *queue)
@@ -226,6 +564,292 @@ mpsc_queue_pop(struct mpsc_queue *queue)
     return node;
 }
 
+static inline
+size_t mpsc_queue_pop_batch(struct mpsc_queue *queue,
+                            size_t n_nodes,
+                            struct mpsc_queue_node *nodes[n_nodes])
+{
+    struct mpsc_queue_node *tail;
+    struct mpsc_queue_node *next;
+    struct mpsc_queue_node *head;
+    bool retry = false;
+    size_t n = 0;
+
+    /* Same logic as 'mpsc_queue_poll', but the tail is kept
+     * locally and written back once. */
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    while (n < n_nodes) {
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+        if (tail == &queue->stub) {
+            if (next == NULL) {
+                /* Empty, unless a producer is inserting after the stub. */
+                head = atomic_load_explicit(&queue->head,
+                                            memory_order_acquire);
+                retry = tail != head;
+                break;
+            }
+            mpsc_queue_stub_unlink(queue);
+            tail = next;
+            continue;
+        }
+
+        if (next == NULL) {
+            head = atomic_load_explicit(&queue->head, memory_order_acquire);
+            if (tail != head) {
+                retry = true;
+                break;
+            }
+            mpsc_queue_insert_stub(queue);
+            next = atomic_load_explicit(&tail->next, memory_order_acquire);
+            if (next == NULL) {
+                retry = true;
+                break;
+            }
+        }
+
+        nodes[n++] = tail;
+        tail = next;
+    }
+    atomic_store_explicit(&queue->tail, tail, memory_order_relaxed);
+
+    MPSC_QUEUE_STATS_CONSUMER(queue, polls, 1);
+    MPSC_QUEUE_STATS_CONSUMER(queue, items, n);
+    if (retry) {
+        MPSC_QUEUE_STATS_CONSUMER(queue, retries, 1);
+    } else if (n == 0 && tail == &queue->stub) {
+        MPSC_QUEUE_STATS_CONSUMER(queue, empty, 1);
+    }
+
+    return n;
+}
+
+static inline
+struct mpsc_queue_chain mpsc_queue_take_all(struct mpsc_queue *queue)
+{
+    struct mpsc_queue_chain chain = { NULL, NULL };
+    struct mpsc_queue_node *tail;
+    struct mpsc_queue_node *next;
+    struct mpsc_queue_node *prev;
+
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if (tail != &queue->stub && !mpsc_queue_stub_is_linked(queue)) {
+        /* Common case: the stub is free, use it as the new head. */
+        atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+        chain.first = tail;
+        chain.last = atomic_exchange_explicit(&queue->head, &queue->stub,
+                                              memory_order_acq_rel);
+        atomic_store_explicit(&queue->tail, &queue->stub,
+                              memory_order_relaxed);
+        return chain;
+    }
+
+    /* The stub is still linked, possibly behind nodes pushed in front
+     * of it. Move those first, there are usually none or very few. */
+    prev = NULL;
+    while (tail != &queue->stub) {
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (next == NULL) {
+            /* Insertion in progress, take what is available. */
+            atomic_store_explicit(&queue->tail, tail, memory_order_relaxed);
+            chain.last = prev;
+            return chain;
+        }
+        if (chain.first == NULL) {
+            chain.first = tail;
+        }
+        prev = tail;
+        tail = next;
+    }
+
+    next = atomic_load_explicit(&queue->stub.next, memory_order_acquire);
+    if (next == NULL) {
+        /* Nothing after the stub, or a producer is linking to it. */
+        atomic_store_explicit(&queue->tail, &queue->stub,
+                              memory_order_relaxed);
+        chain.last = prev;
+        return chain;
+    }
+
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    chain.last = atomic_exchange_explicit(&queue->head, &queue->stub,
+                                          memory_order_acq_rel);
+    atomic_store_explicit(&queue->tail, &queue->stub, memory_order_relaxed);
+
+    if (prev != NULL) {
+        atomic_store_explicit(&prev->next, next, memory_order_relaxed);
+    } else {
+        chain.first = next;
+    }
+
+    return chain;
+}
+
+static inline
+struct mpsc_queue_node *
+mpsc_queue_chain_pop(struct mpsc_queue_chain *chain)
+{
+    struct mpsc_queue_node *node = chain->first;
+    struct mpsc_queue_node *next;
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (node == chain->last) {
+        chain->first = NULL;
+        chain->last = NULL;
+        return node;
+    }
+
+    do {
+        next = atomic_load_explicit(&node->next, memory_order_acquire);
+    } while (next == NULL);
+    chain->first = next;
+
+    return node;
+}
+
+static inline void
+mpsc_queue_consumer_init(struct mpsc_queue_consumer *consumer,
+                         struct mpsc_queue *queue)
+{
+    consumer->queue = queue;
+    consumer->held = NULL;
+}
+
+static inline enum mpsc_queue_poll_result
+mpsc_queue_consumer_poll__(struct mpsc_queue_consumer *consumer,
+                           struct mpsc_queue_node **node,
+                           struct mpsc_queue_node **released)
+{
+    struct mpsc_queue *queue = consumer->queue;
+    struct mpsc_queue_node *tail;
+    struct mpsc_queue_node *next;
+    struct mpsc_queue_node *head;
+
+    *released = NULL;
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &queue->stub || tail == consumer->held) {
+        if (next == NULL) {
+            head = atomic_load_explicit(&queue->head, memory_order_acquire);
+            if (tail != head) {
+                return MPSC_QUEUE_RETRY;
+            } else {
+                return MPSC_QUEUE_EMPTY;
+            }
+        }
+
+        atomic_store_explicit(&queue->tail, next, memory_order_relaxed);
+        if (tail == &queue->stub) {
+            mpsc_queue_stub_unlink(queue);
+        } else {
+            consumer->held = NULL;
+            *released = tail;
+        }
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next != NULL) {
+        atomic_store_explicit(&queue->tail, next, memory_order_relaxed);
+        *node = tail;
+        return MPSC_QUEUE_ITEM;
+    }
+
+    head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail != head) {
+        return MPSC_QUEUE_RETRY;
+    }
+
+    /* Last node: hold it instead of inserting the stub. */
+    consumer->held = tail;
+    *node = tail;
+    return MPSC_QUEUE_ITEM;
+}
+
+static inline enum mpsc_queue_poll_result
+mpsc_queue_consumer_poll(struct mpsc_queue_consumer *consumer,
+                         struct mpsc_queue_node **node,
+                         struct mpsc_queue_node **released)
+{
+    return mpsc_queue_stats_poll(consumer->queue,
+                                 mpsc_queue_consumer_poll__(consumer, node,
+                                                            released));
+}
+
+static inline struct mpsc_queue_node *
+mpsc_queue_consumer_pop(struct mpsc_queue_consumer *consumer,
+                        struct mpsc_queue_node **released)
+{
+    enum mpsc_queue_poll_result result;
+    struct mpsc_queue_node *node;
+    struct mpsc_queue_node *rel;
+
+    *released = NULL;
+    do {
+        result = mpsc_queue_consumer_poll(consumer, &node, &rel);
+        if (rel != NULL) {
+            *released = rel;
+        }
+        if (result == MPSC_QUEUE_EMPTY) {
+            return NULL;
+        }
+    } while (result == MPSC_QUEUE_RETRY);
+
+    return node;
+}
+
+static inline struct mpsc_queue_node *
+mpsc_queue_consumer_release(struct mpsc_queue_consumer *consumer)
+{
+    struct mpsc_queue *queue = consumer->queue;
+    struct mpsc_queue_node *held = consumer->held;
+    struct mpsc_queue_node *next;
+    struct mpsc_queue_node *head;
+
+    if (held == NULL) {
+        return NULL;
+    }
+
+    next = atomic_load_explicit(&held->next, memory_order_acquire);
+    if (next == NULL) {
+        head = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (head == held) {
+            mpsc_queue_insert_stub(queue);
+        }
+        /* Either the stub or a concurrent insertion is being linked
+         * after the held node. */
+        do {
+            next = atomic_load_explicit(&held->next, memory_order_acquire);
+        } while (next == NULL);
+    }
+
+    atomic_store_explicit(&queue->tail, next, memory_order_relaxed);
+    consumer->held = NULL;
+    return held;
+}
+
+static inline bool
+mpsc_queue_consumer_is_empty(struct mpsc_queue_consumer *consumer)
+{
+    struct mpsc_queue *queue = consumer->queue;
+    struct mpsc_queue_node *tail;
+    struct mpsc_queue_node *next;
+    struct mpsc_queue_node *head;
+
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    return ((tail == &queue->stub || tail == consumer->held) &&
+            next == NULL &&
+            tail == head);
+}
+
 static inline struct mpsc_queue_node *
 mpsc_queue_tail(struct mpsc_queue *queue)
 {
@@ -241,6 +865,7 @@ mpsc_queue_tail(struct mpsc_queue *queue)
         }
 
         atomic_store_explicit(&queue->tail, next, memory_order_relaxed);
+        mpsc_queue_stub_unlink(queue);
         tail = next;
     }
 
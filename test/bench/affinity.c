@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "affinity.h"
+
+static const char *placement_names[] = {
+    [PLACEMENT_NONE] = "none",
+    [PLACEMENT_SMT] = "smt",
+    [PLACEMENT_SOCKET] = "socket",
+    [PLACEMENT_CROSS_SOCKET] = "cross-socket",
+};
+
+bool
+placement_from_string(const char *s, enum placement *placement)
+{
+    for (size_t i = 0; i < sizeof placement_names / sizeof placement_names[0];
+         i++) {
+        if (!strcmp(s, placement_names[i])) {
+            *placement = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+placement_to_string(enum placement placement)
+{
+    return placement_names[placement];
+}
+
+int
+cpu_list_parse(const char *s, int cpus[], size_t max)
+{
+    size_t n = 0;
+
+    while (*s != '\0') {
+        long int first, last;
+        char *end;
+
+        first = strtol(s, &end, 10);
+        if (end == s || first < 0) {
+            return -1;
+        }
+        last = first;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first) {
+                return -1;
+            }
+        }
+        for (long int cpu = first; cpu <= last; cpu++) {
+            if (n == max) {
+                return -1;
+            }
+            cpus[n++] = cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        s = end;
+    }
+
+    return n;
+}
+
+#ifdef __linux__
+
+/* Read an integer attribute of a CPU, -1 if it cannot be read. */
+static int
+cpu_topology_read(int cpu, const char *name)
+{
+    char path[128];
+    FILE *f;
+    int value;
+
+    snprintf(path, sizeof path,
+             "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    if (fscanf(f, "%d", &value) != 1) {
+        value = -1;
+    }
+    fclose(f);
+    return value;
+}
+
+static bool
+cpu_allowed(cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    return sched_getaffinity(0, sizeof *set, set) == 0;
+}
+
+int
+cpu_first_allowed(void)
+{
+    cpu_set_t set;
+
+    if (cpu_allowed(&set)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                return cpu;
+            }
+        }
+    }
+    return 0;
+}
+
+size_t
+placement_cpus(enum placement placement, int consumer_cpu,
+               int cpus[], size_t max)
+{
+    int package = cpu_topology_read(consumer_cpu, "physical_package_id");
+    int core = cpu_topology_read(consumer_cpu, "core_id");
+    cpu_set_t set;
+    size_t n = 0;
+
+    if (placement == PLACEMENT_NONE || package < 0 || core < 0 ||
+        !cpu_allowed(&set)) {
+        return 0;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++) {
+        bool same_package, same_core;
+
+        if (cpu == consumer_cpu || !CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        same_package = cpu_topology_read(cpu, "physical_package_id")
+                       == package;
+        same_core = same_package &&
+                    cpu_topology_read(cpu, "core_id") == core;
+
+        if ((placement == PLACEMENT_SMT && same_core) ||
+            (placement == PLACEMENT_SOCKET && same_package && !same_core) ||
+            (placement == PLACEMENT_CROSS_SOCKET && !same_package)) {
+            cpus[n++] = cpu;
+        }
+    }
+
+    return n;
+}
+
+int
+cpu_numa_node(int cpu)
+{
+    char path[64];
+    struct dirent *de;
+    int node = -1;
+    DIR *dir;
+
+    /* The node of a CPU is the 'nodeN' link in its directory. */
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "node%d", &node) == 1) {
+            break;
+        }
+        node = -1;
+    }
+    closedir(dir);
+    return node;
+}
+
+int
+cpu_pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return EINVAL;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+}
+
+#else
+
+int
+cpu_first_allowed(void)
+{
+    return 0;
+}
+
+size_t
+placement_cpus(enum placement placement, int consumer_cpu,
+               int cpus[], size_t max)
+{
+    (void) placement;
+    (void) consumer_cpu;
+    (void) cpus;
+    (void) max;
+    return 0;
+}
+
+int
+cpu_numa_node(int cpu)
+{
+    (void) cpu;
+    return -1;
+}
+
+int
+cpu_pin(int cpu)
+{
+    (void) cpu;
+    return ENOTSUP;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Placement of the benchmark threads on CPUs.
+ *
+ * The topology is read from sysfs. On systems other than Linux,
+ * threads cannot be pinned and no placement policy matches any CPU. */
+
+/* Where producers run, relative to the consumer. */
+enum placement {
+    PLACEMENT_NONE,
+    /* On the SMT siblings of the consumer core. */
+    PLACEMENT_SMT,
+    /* On other cores of the consumer socket. */
+    PLACEMENT_SOCKET,
+    /* On other sockets. */
+    PLACEMENT_CROSS_SOCKET,
+};
+
+bool placement_from_string(const char *s, enum placement *placement);
+const char *placement_to_string(enum placement placement);
+
+/* Parse a list of CPUs such as "0-3,8". Returns the number of CPUs,
+ * or -1 if the list is invalid or holds more than 'max' CPUs. */
+int cpu_list_parse(const char *s, int cpus[], size_t max);
+
+/* The first CPU the process is allowed to run on. */
+int cpu_first_allowed(void);
+
+/* Fill 'cpus' with the allowed CPUs matching 'placement' relative to
+ * 'consumer_cpu'. Returns their number, 0 if none matches. */
+size_t placement_cpus(enum placement placement, int consumer_cpu,
+                      int cpus[], size_t max);
+
+/* NUMA node of a CPU, -1 if unknown. */
+int cpu_numa_node(int cpu);
+
+/* Pin the calling thread to a CPU. Returns 0 or an errno value. */
+int cpu_pin(int cpu);
+
+#endif /* AFFINITY_H */
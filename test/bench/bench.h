@@ -0,0 +1,34 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct mpscq;
+
+/* Measure the consumer wake-up latency and its CPU usage while idle,
+ * for each wait strategy. */
+void bench_wait(unsigned int n_msgs, unsigned int interval_us, bool csv);
+
+/* Compare signaling an eventfd on each insertion with signaling it
+ * only when the queue was drained, for bursts of messages. */
+void bench_notify(unsigned int n_msgs, unsigned int burst,
+                  unsigned int interval_us, bool csv);
+
+/* Run pairs of threads, each on its own queue, with the queues
+ * adjacent in memory or spaced apart. */
+void bench_false_sharing(unsigned int n_msgs, unsigned int n_pairs, bool csv);
+
+/* Time individual insertions, batch insertions and pops with the TSC,
+ * for 1, 2, 4, ... up to 'max_threads' producers. */
+void bench_op_cost(struct mpscq *queues[], size_t n_queues,
+                   unsigned int n_msgs, unsigned int max_threads,
+                   unsigned int batch_size, bool csv);
+
+/* Measure round trips between clients and a server, each receiving
+ * on its own queue: with one client, then with 'n_clients' sharing
+ * the server queue. */
+void bench_ping_pong(struct mpscq *queues[], size_t n_queues,
+                     unsigned int n_msgs, unsigned int n_clients, bool csv);
+
+#endif /* BENCH_H */
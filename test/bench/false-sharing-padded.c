@@ -0,0 +1,8 @@
+/* The false sharing runs, with 'head' and 'tail'
+ * on separate cache lines. */
+#define MPSC_QUEUE_CACHE_ALIGNED
+#define FS_RUN fs_run_padded
+
+#include "false-sharing.c"
+
+const size_t fs_padded_queue_size = sizeof(struct mpsc_queue);
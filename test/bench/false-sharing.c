@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <pthread.h>
+#include <sched.h>
+#if __APPLE__
+#include "pthread-barrier.h"
+#endif
+
+#include "mpsc-queue.h"
+#include "bench.h"
+#include "util.h"
+
+/* Each pair of threads, one producer and one consumer,
+ * uses its own queue. Only the placement of the queues in
+ * memory changes between runs. */
+struct fs_pair {
+    struct mpsc_queue *queue;
+    struct mpsc_queue_node *nodes;
+    pthread_barrier_t *barrier;
+    unsigned int n_msgs;
+};
+
+struct fs_layout {
+    const char *name;
+    /* Distance between two queues, in bytes. */
+    size_t stride;
+    long long int (*run)(const struct fs_layout *layout,
+                         unsigned int n_pairs, unsigned int n_msgs);
+};
+
+/* This file is built again by 'false-sharing-padded.c', with the
+ * cache-aligned queue layout and only the run function, renamed. */
+#ifndef FS_RUN
+#define FS_RUN fs_run
+
+long long int fs_run_padded(const struct fs_layout *layout,
+                            unsigned int n_pairs, unsigned int n_msgs);
+extern const size_t fs_padded_queue_size;
+#endif
+
+static void *
+fs_producer_main(void *aux)
+{
+    struct fs_pair *pair = aux;
+
+    pthread_barrier_wait(pair->barrier);
+    for (unsigned int i = 0; i < pair->n_msgs; i++) {
+        mpsc_queue_insert(pair->queue, &pair->nodes[i]);
+    }
+    return NULL;
+}
+
+static void *
+fs_consumer_main(void *aux)
+{
+    struct fs_pair *pair = aux;
+    unsigned int n = 0;
+
+    pthread_barrier_wait(pair->barrier);
+    while (n < pair->n_msgs) {
+        if (mpsc_queue_pop(pair->queue) != NULL) {
+            n++;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+long long int
+FS_RUN(const struct fs_layout *layout, unsigned int n_pairs,
+       unsigned int n_msgs)
+{
+    size_t size = ROUND_UP(n_pairs * layout->stride,
+                           MPSC_QUEUE_CACHE_LINE_SIZE);
+    pthread_t *threads;
+    pthread_barrier_t barrier;
+    struct fs_pair *pairs;
+    long long int start;
+    char *area;
+
+    area = aligned_alloc(MPSC_QUEUE_CACHE_LINE_SIZE, size);
+    if (area == NULL) {
+        out_of_memory();
+    }
+    pairs = xcalloc(n_pairs, sizeof *pairs);
+    threads = xcalloc(2 * n_pairs, sizeof *threads);
+    pthread_barrier_init(&barrier, NULL, 2 * n_pairs + 1);
+
+    for (unsigned int i = 0; i < n_pairs; i++) {
+        pairs[i].queue = (void *) (area + i * layout->stride);
+        pairs[i].nodes = xcalloc(n_msgs, sizeof *pairs[i].nodes);
+        pairs[i].barrier = &barrier;
+        pairs[i].n_msgs = n_msgs;
+        mpsc_queue_init(pairs[i].queue);
+        pthread_create(&threads[2 * i], NULL, fs_consumer_main, &pairs[i]);
+        pthread_create(&threads[2 * i + 1], NULL, fs_producer_main, &pairs[i]);
+    }
+
+    start = time_usec();
+    pthread_barrier_wait(&barrier);
+    for (unsigned int i = 0; i < 2 * n_pairs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    start = time_usec() - start;
+
+    pthread_barrier_destroy(&barrier);
+    for (unsigned int i = 0; i < n_pairs; i++) {
+        free(pairs[i].nodes);
+    }
+    free(threads);
+    free(pairs);
+    free(area);
+
+    return start / 1000;
+}
+
+#ifndef MPSC_QUEUE_CACHE_ALIGNED
+void
+bench_false_sharing(unsigned int n_msgs, unsigned int n_pairs, bool csv)
+{
+    /* Spaced queues are two lines apart, as some CPUs
+     * prefetch cache lines by pairs. Padded queues are adjacent, but
+     * their 'head' and 'tail' are on separate lines, as with
+     * MPSC_QUEUE_CACHE_ALIGNED. */
+    const struct fs_layout layouts[] = {
+        { "adjacent", sizeof(struct mpsc_queue), fs_run },
+        { "spaced", ROUND_UP(sizeof(struct mpsc_queue),
+                             2 * MPSC_QUEUE_CACHE_LINE_SIZE), fs_run },
+        { "padded", fs_padded_queue_size, fs_run_padded },
+    };
+
+    if (!csv) {
+        printf("Benchmarking false sharing, n=%u on %u queues "
+               "of %zu bytes.\n", n_msgs, n_pairs, sizeof(struct mpsc_queue));
+        printf("         layout:  stride     time\n");
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(layouts); i++) {
+        long long int ms = layouts[i].run(&layouts[i], n_pairs, n_msgs);
+
+        if (csv) {
+            printf("false-sharing-%s-%u,%lld\n", layouts[i].name, n_pairs, ms);
+        } else {
+            printf("%*s:  %6zu %6lld ms\n", 15, layouts[i].name,
+                   layouts[i].stride, ms);
+        }
+    }
+}
+#endif
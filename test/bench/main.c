@@ -11,23 +11,120 @@
 #include "pthread-barrier.h"
 #endif
 
+#include "mpsc-queue-pool.h"
+
+#include "affinity.h"
+#include "bench.h"
+#include "perf-counters.h"
+#include "queue-ops.h"
+#include "scenario.h"
+#include "histogram.h"
 #include "mpscq.h"
 #include "util.h"
 
 #define MAX_BATCH_SIZE 64
 #define DEFAULT_BATCH_SIZE 64
+#define DESC_WIDTH 20
+#define MAX_CPUS 1024
+/* Messages consumed between two samples of the queue depth. */
+#define DEPTH_SAMPLE_INTERVAL 64
+#define MAX_PAYLOAD_SIZE 4096
 
 struct element {
     union mpscq_node node;
     uint64_t mark;
+    /* Insertion time, in nanoseconds. */
+    uint64_t stamp;
+    /* Written by the producer, read by the consumer. */
+    uint64_t payload[];
+};
+
+/* Where producers take their elements from. */
+enum alloc_mode {
+    /* A single array, allocated beforehand. */
+    ALLOC_STATIC,
+    /* malloc() by producers, free() by the consumer. */
+    ALLOC_MALLOC,
+    /* Per-producer pools, recycled by the consumer. */
+    ALLOC_POOL,
+};
+
+/* Where the elements of the array are. */
+enum layout {
+    /* Contiguous, in the order producers take them. */
+    LAYOUT_CONTIGUOUS,
+    /* In the array, in a random order. */
+    LAYOUT_SHUFFLED,
+    /* Each one allocated on its own with malloc(), scattered. */
+    LAYOUT_HEAP,
+};
+
+struct heap_element {
+    struct mpsc_queue_pool_node pnode;
+    struct element elem;
+};
+
+/* Elements of 'elements' inserted by a producer. */
+struct producer_share {
+    unsigned int first;
+    unsigned int count;
+};
+
+/* Insertions done by a producer, read by the consumer. */
+struct producer_progress {
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) _Atomic(uint64_t) n_inserted;
 };
 
 static bool print_csv;
 
+static enum alloc_mode alloc_mode;
+static struct mpsc_queue_pool *pools;
+static struct mpsc_queue_pool_recycler recycler;
+
 static struct element *elements;
+static struct element *elements_end;
+static enum layout layout;
+/* Elements in order, if they are not contiguous in 'elements'. */
+static struct element **element_table;
+static size_t element_size;
+static size_t payload_size;
+static volatile uint64_t payload_sink;
 static uint64_t *thread_working_ms;
+static struct producer_share *shares;
+/* Elements after the shares, inserted before the producers start. */
+static unsigned int leftovers;
+
+/* Load applied to the queues, and the queue depth it led to,
+ * sampled by the consumer. */
+static struct scenario scenario;
+static bool with_scenario;
+static struct producer_progress *progress;
+static uint64_t depth_sum;
+static uint64_t depth_max;
+static uint64_t n_depth_samples;
 
 static unsigned int batch_size;
+static unsigned int pop_batch_size;
+static bool take_all;
+static bool stub_stats;
+/* Call the queues through their vtable, even when a specialized
+ * loop exists. */
+static bool use_vtable;
+static bool record_latency;
+/* Time spent by elements in the queue, recorded by the consumer. */
+static struct histogram latency;
+
+/* Hardware counters, summed over the measured regions. */
+static bool perf_counters;
+static struct perf_counters consumer_pc;
+static struct perf_values producers_perf;
+static struct perf_values consumer_perf;
+
+/* CPU placement, if requested. Producers cycle over their CPUs. */
+static int consumer_cpu = -1;
+static int *producer_cpus;
+static size_t n_producer_cpus;
+
 static unsigned int n_threads;
 static unsigned int n_elems;
 static bool warming;
@@ -44,13 +141,91 @@ elapsed(const struct timespec *start)
     return timespec_to_msec(&end) - timespec_to_msec(start);
 }
 
+static void
+print_cpu(int cpu)
+{
+    int node = cpu_numa_node(cpu);
+
+    if (node >= 0) {
+        printf(" %d (node %d)", cpu, node);
+    } else {
+        printf(" %d", cpu);
+    }
+}
+
+static void
+print_placement(void)
+{
+    if (consumer_cpu >= 0) {
+        printf("Consumer on CPU");
+        print_cpu(consumer_cpu);
+        printf(".\n");
+    }
+    if (n_producer_cpus > 0) {
+        printf("Producers on CPUs");
+        for (unsigned int i = 0; i < n_threads; i++) {
+            print_cpu(producer_cpus[i % n_producer_cpus]);
+        }
+        printf(".\n");
+    }
+}
+
+static void
+print_scenario(void)
+{
+    printf("Scenario:");
+    if (scenario.arrival != ARRIVAL_CLOSED) {
+        printf(" %s arrivals at %" PRIu64 " msg/s",
+               arrival_to_string(scenario.arrival), scenario.rate);
+        if (scenario.arrival == ARRIVAL_BURST) {
+            printf(" by %u", scenario.burst);
+        }
+    }
+    if (scenario.skew != 0) {
+        printf(" skew %.2f", scenario.skew);
+    }
+    if (scenario.work_ns != 0) {
+        printf(" work %" PRIu64 " ns/msg", scenario.work_ns);
+    }
+    if (scenario.stall_us != 0 && scenario.stall_every != 0) {
+        printf(" stall %u us every %u msgs",
+               scenario.stall_us, scenario.stall_every);
+    }
+    printf(".\n");
+}
+
 static void
 print_header(void)
 {
     if (!print_csv) {
         printf("Benchmarking n=%u,batch=%u on 1 + %u threads.\n",
                 n_elems, batch_size, n_threads);
-        printf("    type\\thread:  Reader ");
+        if (payload_size != 0) {
+            printf("Elements carry a %zu bytes payload.\n", payload_size);
+        }
+        if (layout == LAYOUT_SHUFFLED) {
+            printf("Elements are shuffled in the array.\n");
+        } else if (layout == LAYOUT_HEAP) {
+            printf("Elements are allocated one by one.\n");
+        }
+        print_placement();
+        if (with_scenario) {
+            print_scenario();
+        }
+        if (use_vtable) {
+            printf("Queues are called through their vtable.\n");
+        }
+        if (take_all) {
+            printf("Consumer detaches the whole queue at once.\n");
+        } else if (pop_batch_size > 1) {
+            printf("Consumer pops up to %u nodes at once.\n", pop_batch_size);
+        }
+        if (alloc_mode == ALLOC_MALLOC) {
+            printf("Elements are allocated with malloc().\n");
+        } else if (alloc_mode == ALLOC_POOL) {
+            printf("Elements are allocated from per-producer pools.\n");
+        }
+        printf("%*s:  Reader ", DESC_WIDTH, "type\\thread");
         for (unsigned int i = 0; i < n_threads; i++) {
             printf("   %3u ", i + 1);
         }
@@ -58,6 +233,87 @@ print_header(void)
     }
 }
 
+static void
+print_latency(struct mpscq *q)
+{
+    static const struct {
+        const char *name;
+        double pct;
+    } percentiles[] = {
+        { "p50", 50 },
+        { "p90", 90 },
+        { "p99", 99 },
+        { "p99.9", 99.9 },
+        { "max", 100 },
+    };
+
+    if (!print_csv) {
+        printf("%*s  ", DESC_WIDTH, "");
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        uint64_t value = histogram_percentile(&latency, percentiles[i].pct);
+
+        if (print_csv) {
+            printf("%s-%u-latency-%s-ns,%" PRIu64 "\n",
+                   q->desc, batch_size, percentiles[i].name, value);
+        } else {
+            printf(" %s %" PRIu64, percentiles[i].name, value);
+        }
+    }
+    if (!print_csv) {
+        printf(" ns\n");
+    }
+}
+
+static void
+print_perf(struct mpscq *q, const char *side, struct perf_values *sum)
+{
+    if (!print_csv) {
+        printf("%*s   %-9s", DESC_WIDTH, "", side);
+    }
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        uint64_t value = atomic_load(&sum->values[i]);
+
+        if (!perf_counter_available(&consumer_pc, i)) {
+            if (!print_csv) {
+                printf(" %s n/a", perf_counter_names[i]);
+            }
+        } else if (print_csv) {
+            /* Integer values: per thousand messages. */
+            printf("%s-%u-perf-%s-%s-per-kmsg,%" PRIu64 "\n",
+                   q->desc, batch_size, side, perf_counter_names[i],
+                   value * 1000 / n_elems);
+        } else {
+            printf(" %s %.2f", perf_counter_names[i],
+                   (double) value / n_elems);
+        }
+    }
+    if (!print_csv) {
+        printf(" per msg\n");
+    }
+}
+
+static void
+print_load(struct mpscq *q, long long int consumer_time)
+{
+    uint64_t throughput = consumer_time ? n_elems * 1000ull / consumer_time
+                                        : 0;
+    double depth_avg = n_depth_samples ? (double) depth_sum / n_depth_samples
+                                       : 0;
+
+    if (print_csv) {
+        printf("%s-%u-throughput-msg-per-s,%" PRIu64 "\n",
+               q->desc, batch_size, throughput);
+        printf("%s-%u-depth-avg,%.0f\n",
+               q->desc, batch_size, depth_avg);
+        printf("%s-%u-depth-max,%" PRIu64 "\n",
+               q->desc, batch_size, depth_max);
+    } else {
+        printf("%*s   %" PRIu64 " msg/s, depth avg %.2f max %" PRIu64 "\n",
+               DESC_WIDTH, "", throughput, depth_avg, depth_max);
+    }
+}
+
 static void
 print_test_result(struct mpscq *q, long long int consumer_time)
 {
@@ -76,24 +332,197 @@ print_test_result(struct mpscq *q, long long int consumer_time)
         printf("%s-%u-producers-avg,%" PRIu64 "\n",
                q->desc, batch_size, avg);
     } else {
-        printf("%*s:  %6lld", 15, q->desc, consumer_time);
+        printf("%*s:  %6lld", DESC_WIDTH, q->desc, consumer_time);
         for (i = 0; i < n_threads; i++) {
             printf(" %6" PRIu64, thread_working_ms[i]);
         }
         printf(" %6" PRIu64 " ms\n", avg);
     }
+
+    if (with_scenario) {
+        print_load(q, consumer_time);
+    }
+
+    if (record_latency) {
+        print_latency(q);
+    }
+
+    if (perf_counters) {
+        print_perf(q, "producers", &producers_perf);
+        print_perf(q, "consumer", &consumer_perf);
+    }
+
+    if (stub_stats && mpscq_has_stub_stats(q)) {
+        if (print_csv) {
+            printf("%s-%u-stub-inserts,%" PRIu64 "\n",
+                   q->desc, batch_size, mpscq_n_stub_inserts(q));
+        } else {
+            printf("%*s   %" PRIu64 " stub insertions\n",
+                   DESC_WIDTH, "", mpscq_n_stub_inserts(q));
+        }
+    }
+}
+
+static struct element *
+element_at(size_t n)
+{
+    if (element_table != NULL) {
+        return element_table[n];
+    }
+    return (struct element *) (void *) ((char *) elements + n * element_size);
+}
+
+static struct element *
+element_get(unsigned int id, size_t n)
+{
+    struct mpsc_queue_pool_node *pnode;
+    struct heap_element *he;
+
+    switch (alloc_mode) {
+    case ALLOC_MALLOC:
+        he = xmalloc(sizeof *he + payload_size);
+        return &he->elem;
+    case ALLOC_POOL:
+        pnode = mpsc_queue_pool_get(&pools[id]);
+        if (pnode == NULL) {
+            out_of_memory();
+        }
+        he = container_of(pnode, struct heap_element, pnode);
+        return &he->elem;
+    case ALLOC_STATIC:
+    default:
+        return element_at(n);
+    }
+}
+
+static void
+element_put(struct element *elem)
+{
+    struct heap_element *he;
+
+    /* Leftover elements are always inserted from the array,
+     * contiguous with other allocation modes. */
+    if (alloc_mode == ALLOC_STATIC ||
+        (elem >= elements && elem < elements_end)) {
+        return;
+    }
+
+    he = container_of(elem, struct heap_element, elem);
+    if (alloc_mode == ALLOC_MALLOC) {
+        free(he);
+    } else {
+        mpsc_queue_pool_put(&recycler, &he->pnode);
+    }
+}
+
+static uint64_t
+latency_now(void)
+{
+    return record_latency ? time_nsec() : 0;
+}
+
+static void
+payload_write(struct element *elem, uint64_t value)
+{
+    for (size_t i = 0; i < payload_size / sizeof elem->payload[0]; i++) {
+        elem->payload[i] = value;
+    }
+}
+
+static uint64_t
+payload_read(struct element *elem)
+{
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < payload_size / sizeof elem->payload[0]; i++) {
+        sum += elem->payload[i];
+    }
+    return sum;
+}
+
+static void
+sample_depth(unsigned int counter)
+{
+    uint64_t n_inserted = n_elems - leftovers;
+    uint64_t depth = 0;
+
+    for (unsigned int i = 0; i < n_threads; i++) {
+        n_inserted += atomic_load_explicit(&progress[i].n_inserted,
+                                           memory_order_relaxed);
+    }
+    /* Producers publish their progress after inserting. */
+    if (n_inserted > counter) {
+        depth = n_inserted - counter;
+    }
+    depth_sum += depth;
+    depth_max = MAX(depth_max, depth);
+    n_depth_samples++;
 }
 
 static void
 mark_element(union mpscq_node *node,
              uint64_t mark,
-             unsigned int *counter)
+             unsigned int *counter,
+             uint64_t now)
 {
     struct element *elem;
 
     elem = container_of(node, struct element, node);
     elem->mark = mark;
+    if (payload_size != 0) {
+        payload_sink += payload_read(elem);
+    }
+    if (record_latency) {
+        histogram_record(&latency, now - elem->stamp);
+    }
     *counter += 1;
+    element_put(elem);
+    if (with_scenario) {
+        scenario_consume(&scenario, *counter);
+        if (*counter % DEPTH_SAMPLE_INTERVAL == 0) {
+            sample_depth(*counter);
+        }
+    }
+}
+
+/* The benchmark loops are written once, taking the queue operations
+ * as arguments, and specialized for each queue by 'BENCH_LOOPS'. */
+#define BENCH_ALWAYS_INLINE inline __attribute__((always_inline))
+
+static BENCH_ALWAYS_INLINE void
+consume__(struct mpscq *q, uint64_t epoch, unsigned int *counter,
+          union mpscq_node *(*pop)(struct mpscq *),
+          size_t (*pop_batch)(struct mpscq *, size_t, union mpscq_node **))
+{
+    union mpscq_node *batch[MAX_BATCH_SIZE];
+    union mpscq_node *node;
+    size_t i, n;
+
+    /* Nodes removed at once are stamped with the same time. */
+    if (take_all && mpscq_has_take_all(q)) {
+        struct mpscq_chain chain = mpscq_take_all(q);
+        uint64_t now = latency_now();
+
+        while ((node = mpscq_chain_pop(q, &chain))) {
+            mark_element(node, epoch, counter, now);
+        }
+    } else if (pop_batch_size > 1) {
+        while ((n = pop_batch(q, pop_batch_size, batch))) {
+            uint64_t now = latency_now();
+
+            for (i = 0; i < n; i++) {
+                mark_element(batch[i], epoch, counter, now);
+            }
+        }
+    } else {
+        while ((node = pop(q))) {
+            mark_element(node, epoch, counter, latency_now());
+        }
+    }
+
+    if (alloc_mode == ALLOC_POOL) {
+        mpsc_queue_pool_recycler_flush(&recycler);
+    }
 }
 
 struct mpscq_aux {
@@ -101,45 +530,200 @@ struct mpscq_aux {
     _Atomic(unsigned int) thread_id;
 };
 
+static void
+compute_shares(void)
+{
+    unsigned int counts[n_threads];
+
+    scenario_shares(&scenario, n_elems, n_threads, counts);
+    leftovers = 0;
+    for (unsigned int i = 0; i < n_threads; i++) {
+        shares[i].first = leftovers;
+        shares[i].count = counts[i];
+        leftovers += counts[i];
+    }
+}
+
+static void
+progress_add(unsigned int id, unsigned int n)
+{
+    _Atomic(uint64_t) *n_inserted = &progress[id].n_inserted;
+
+    /* The producer is the only writer. */
+    atomic_store_explicit(n_inserted,
+                          atomic_load_explicit(n_inserted,
+                                               memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+/* Insert 'count' elements, by batches of 'batch_size'. */
+static BENCH_ALWAYS_INLINE void
+produce__(struct mpscq *q, unsigned int id, size_t first,
+          size_t *n, size_t count,
+          void (*insert)(struct mpscq *, union mpscq_node *),
+          void (*insert_batch)(struct mpscq *, size_t, union mpscq_node **))
+{
+    union mpscq_node *batch[MAX_BATCH_SIZE];
+    size_t end = *n + count;
+
+    while (end - *n >= batch_size) {
+        uint64_t now = latency_now();
+
+        for (size_t j = 0; j < batch_size; j++) {
+            struct element *e = element_get(id, first + (*n)++);
+
+            payload_write(e, *n);
+            e->stamp = now;
+            batch[j] = &e->node;
+        }
+        insert_batch(q, batch_size, batch);
+        if (with_scenario) {
+            progress_add(id, batch_size);
+        }
+    }
+    while (*n < end) {
+        struct element *e = element_get(id, first + (*n)++);
+
+        payload_write(e, *n);
+        e->stamp = latency_now();
+        insert(q, &e->node);
+        if (with_scenario) {
+            progress_add(id, 1);
+        }
+    }
+}
+
+struct bench_loops {
+    struct mpscq *queue;
+    void (*produce)(struct mpscq *q, unsigned int id, size_t first,
+                    size_t *n, size_t count);
+    void (*consume)(struct mpscq *q, uint64_t epoch, unsigned int *counter);
+};
+
+#define BENCH_LOOPS(NAME, INSERT, INSERT_BATCH, POP, POP_BATCH)         \
+    static void                                                         \
+    produce_##NAME(struct mpscq *q, unsigned int id, size_t first,      \
+                   size_t *n, size_t count)                             \
+    {                                                                   \
+        produce__(q, id, first, n, count, INSERT, INSERT_BATCH);        \
+    }                                                                   \
+                                                                        \
+    static void                                                         \
+    consume_##NAME(struct mpscq *q, uint64_t epoch,                     \
+                   unsigned int *counter)                               \
+    {                                                                   \
+        consume__(q, epoch, counter, POP, POP_BATCH);                   \
+    }
+
+BENCH_LOOPS(vtable, mpscq_insert, mpscq_insert_batch,
+            mpscq_pop, mpscq_pop_batch)
+BENCH_LOOPS(mpsc_queue, mpsc_queue_insert_op, mpsc_queue_insert_batch_op,
+            mpsc_queue_pop_op, mpsc_queue_pop_batch_op)
+BENCH_LOOPS(tailq, tailq_insert_op, tailq_insert_batch_op,
+            tailq_pop_op, tailq_pop_batch_op)
+BENCH_LOOPS(ts_mpsc_queue, ts_mpsc_queue_insert_op,
+            ts_mpsc_queue_insert_batch_op,
+            ts_mpsc_queue_pop_op, ts_mpsc_queue_pop_batch_op)
+
+static const struct bench_loops vtable_loops = {
+    NULL, produce_vtable, consume_vtable,
+};
+
+static const struct bench_loops specialized_loops[] = {
+    { &mpsc_queue, produce_mpsc_queue, consume_mpsc_queue },
+    { &tailq, produce_tailq, consume_tailq },
+    { &tailq_spin, produce_tailq, consume_tailq },
+    { &tailq_ticket, produce_tailq, consume_tailq },
+    { &tailq_mcs, produce_tailq, consume_tailq },
+    { &ts_mpsc_queue, produce_ts_mpsc_queue, consume_ts_mpsc_queue },
+};
+
+/* Loops used for the queue being benchmarked. */
+static const struct bench_loops *loops;
+
+static const struct bench_loops *
+bench_loops_find(struct mpscq *q)
+{
+    if (use_vtable) {
+        return &vtable_loops;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(specialized_loops); i++) {
+        if (specialized_loops[i].queue == q) {
+            return &specialized_loops[i];
+        }
+    }
+    return &vtable_loops;
+}
+
+/* Pin a producer, then touch its share of 'elements' before anyone
+ * else, so that the kernel backs it with memory from the NUMA node
+ * of the producer. */
+static void
+producer_place(unsigned int id)
+{
+    int cpu = producer_cpus[id % n_producer_cpus];
+    int err;
+
+    err = cpu_pin(cpu);
+    if (err) {
+        fprintf(stderr, "Cannot pin producer %u to CPU %d: %s\n",
+                id + 1, cpu, strerror(err));
+        exit(1);
+    }
+    for (size_t i = 0; i < shares[id].count; i++) {
+        memset(element_at(shares[id].first + i), 0, element_size);
+    }
+}
+
 static void *
 producer_main(void *aux_)
 {
-    union mpscq_node *batch[MAX_BATCH_SIZE];
-    unsigned int n_elems_per_thread;
-    struct element *th_elements;
     struct mpscq_aux *aux = aux_;
+    struct producer_share share;
+    struct perf_counters pc;
     struct timespec start;
-    unsigned int n_batch;
+    struct pacer pacer;
     unsigned int id;
-    size_t i, n;
+    size_t n;
 
     id = atomic_fetch_add(&aux->thread_id, 1u);
+    if (n_producer_cpus > 0) {
+        producer_place(id);
+    }
+    if (perf_counters) {
+        perf_counters_open(&pc);
+    }
+    pthread_barrier_wait(&barrier);
 
     while (true) {
         pthread_barrier_wait(&barrier);
         if (!working) {
             break;
         }
-        n_elems_per_thread = n_elems / n_threads;
-        n_batch = n_elems_per_thread / batch_size;
-        th_elements = &elements[id * n_elems_per_thread];
+        share = shares[id];
         xclock_gettime(&start);
+        pacer_init(&pacer, &scenario, share.count, n_elems, id + 1);
+        if (perf_counters) {
+            perf_counters_start(&pc);
+        }
 
         n = 0;
-        for (i = 0; i < n_batch; i++) {
-            for (size_t j = 0; j < batch_size; j++) {
-                batch[j] = &th_elements[n++].node;
-            }
-            mpscq_insert_batch(aux->queue, batch_size, batch);
-        }
-        while (n < n_elems_per_thread) {
-            mpscq_insert(aux->queue, &th_elements[n++].node);
+        while (n < share.count) {
+            loops->produce(aux->queue, id, share.first, &n,
+                           MIN(pacer_wait(&pacer), share.count - n));
         }
+        mpscq_flush(aux->queue);
 
+        if (perf_counters) {
+            perf_counters_stop(&pc, &producers_perf);
+        }
         thread_working_ms[id] = elapsed(&start);
         pthread_barrier_wait(&barrier);
     }
 
+    if (perf_counters) {
+        perf_counters_close(&pc);
+    }
     return NULL;
 }
 
@@ -147,34 +731,53 @@ static void
 benchmark_mpscq(struct mpscq *q, struct mpscq_aux *aux)
 {
     long long int consumer_time;
-    union mpscq_node *node;
     struct timespec start;
     unsigned int counter;
     uint64_t epoch;
     size_t i;
 
-    memset(elements, 0, n_elems & sizeof *elements);
     memset(thread_working_ms, 0, n_threads & sizeof *thread_working_ms);
 
     mpscq_init(q);
     aux->queue = q;
+    loops = bench_loops_find(q);
+
+    histogram_init(&latency);
+    perf_values_reset(&producers_perf);
+    perf_values_reset(&consumer_perf);
+    for (i = 0; i < n_threads; i++) {
+        atomic_store(&progress[i].n_inserted, 0);
+    }
+    depth_sum = 0;
+    depth_max = 0;
+    n_depth_samples = 0;
+
+    compute_shares();
+    for (i = leftovers; i < n_elems; i++) {
+        struct element *e = element_at(i);
 
-    for (i = n_elems - (n_elems % n_threads); i < n_elems; i++) {
-        mpscq_insert(q, &elements[i].node);
+        payload_write(e, i);
+        e->stamp = latency_now();
+        mpscq_insert(q, &e->node);
     }
+    mpscq_flush(q);
 
     pthread_barrier_wait(&barrier);
 
     xclock_gettime(&start);
+    if (perf_counters) {
+        perf_counters_start(&consumer_pc);
+    }
     counter = 0;
     epoch = 0;
     do {
-        while ((node = mpscq_pop(q))) {
-            mark_element(node, epoch, &counter);
-        }
+        loops->consume(q, epoch, &counter);
         epoch++;
     } while (counter != n_elems);
 
+    if (perf_counters) {
+        perf_counters_stop(&consumer_pc, &consumer_perf);
+    }
     consumer_time = elapsed(&start);
     pthread_barrier_wait(&barrier);
 
@@ -185,11 +788,190 @@ benchmark_mpscq(struct mpscq *q, struct mpscq_aux *aux)
     print_test_result(q, consumer_time);
 }
 
+/* Same order from one run to the other. */
+static void
+element_table_shuffle(void)
+{
+    for (size_t i = n_elems - 1; i > 0; i--) {
+        size_t j = random_u32_range(i + 1);
+        struct element *tmp = element_table[i];
+
+        element_table[i] = element_table[j];
+        element_table[j] = tmp;
+    }
+}
+
+static void
+elements_alloc(void)
+{
+    size_t i;
+
+    element_size = ROUND_UP(sizeof(struct element) + payload_size,
+                            sizeof(uint64_t));
+    random_init(1);
+
+    if (layout == LAYOUT_HEAP) {
+        void **spacers = xcalloc(n_elems, sizeof *spacers);
+
+        /* Allocated one after the other, the elements would be carved
+         * in order from the top of the heap, as in an array. Each one
+         * follows a block of random size freed afterwards, and they are
+         * taken in a random order, as from a fragmented heap. */
+        element_table = xcalloc(n_elems, sizeof *element_table);
+        for (i = 0; i < n_elems; i++) {
+            spacers[i] = xmalloc(random_u32_range(2 * element_size) + 1);
+            element_table[i] = xzalloc(element_size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            free(spacers[i]);
+        }
+        free(spacers);
+        element_table_shuffle();
+        return;
+    }
+
+    elements = xcalloc(n_elems, element_size);
+    elements_end = element_at(n_elems);
+
+    if (layout == LAYOUT_SHUFFLED) {
+        element_table = xcalloc(n_elems, sizeof *element_table);
+        for (i = 0; i < n_elems; i++) {
+            element_table[i] = (struct element *) (void *)
+                               ((char *) elements + i * element_size);
+        }
+        element_table_shuffle();
+    }
+}
+
+static void
+elements_free(void)
+{
+    if (layout == LAYOUT_HEAP) {
+        for (size_t i = 0; i < n_elems; i++) {
+            free(element_table[i]);
+        }
+    }
+    free(element_table);
+    free(elements);
+}
+
+/* Lock variants of the tailq. */
+static const struct {
+    const char *name;
+    struct mpscq *queue;
+} tailq_locks[] = {
+    { "mutex", &tailq },
+    { "spin", &tailq_spin },
+    { "ticket", &tailq_ticket },
+    { "mcs", &tailq_mcs },
+};
+
+/* Select the variants named in the comma-separated list 's',
+ * or all of them. */
+static bool
+tailq_locks_parse(const char *s, bool selected[])
+{
+    bool all = !strcmp(s, "all");
+
+    for (size_t i = 0; i < ARRAY_SIZE(tailq_locks); i++) {
+        selected[i] = all;
+    }
+    while (!all && *s != '\0') {
+        size_t len = strcspn(s, ",");
+        size_t i;
+
+        for (i = 0; i < ARRAY_SIZE(tailq_locks); i++) {
+            if (strlen(tailq_locks[i].name) == len &&
+                !strncmp(s, tailq_locks[i].name, len)) {
+                selected[i] = true;
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(tailq_locks)) {
+            return false;
+        }
+        s += len;
+        s += *s == ',';
+    }
+    return true;
+}
+
+static void
+setup_placement(enum placement placement, const char *cpu_list)
+{
+    int err;
+
+    if (placement != PLACEMENT_NONE && cpu_list != NULL) {
+        printf("--placement and --producer-cpus are exclusive.\n");
+        exit(1);
+    }
+
+    /* A placement is relative to the consumer, which must be pinned. */
+    if (placement != PLACEMENT_NONE && consumer_cpu < 0) {
+        consumer_cpu = cpu_first_allowed();
+    }
+    if (consumer_cpu >= 0) {
+        err = cpu_pin(consumer_cpu);
+        if (err) {
+            fprintf(stderr, "Cannot pin the consumer to CPU %d: %s\n",
+                    consumer_cpu, strerror(err));
+            exit(1);
+        }
+    }
+
+    if (placement == PLACEMENT_NONE && cpu_list == NULL) {
+        return;
+    }
+
+    producer_cpus = xcalloc(MAX_CPUS, sizeof *producer_cpus);
+    if (cpu_list != NULL) {
+        int n = cpu_list_parse(cpu_list, producer_cpus, MAX_CPUS);
+
+        if (n <= 0) {
+            printf("Invalid CPU list '%s'.\n", cpu_list);
+            exit(1);
+        }
+        n_producer_cpus = n;
+    } else {
+        n_producer_cpus = placement_cpus(placement, consumer_cpu,
+                                         producer_cpus, MAX_CPUS);
+        if (n_producer_cpus == 0) {
+            fprintf(stderr, "No CPU matches placement '%s' "
+                    "relative to CPU %d.\n",
+                    placement_to_string(placement), consumer_cpu);
+            exit(1);
+        }
+    }
+}
+
 static void
 run_benchmarks(int argc, const char *argv[])
 {
     bool with_treiber_stack = false;
+    bool with_flat_combining = false;
     bool only_mpsc_queue = false;
+    bool with_tailq_lock[ARRAY_SIZE(tailq_locks)] = { true };
+    bool with_bounded = false;
+    bool with_ring = false;
+    bool with_segq = false;
+    bool with_autobatch = false;
+    bool with_padded = false;
+    bool with_deferred = false;
+    bool with_sp = false;
+    bool with_stats = false;
+    bool false_sharing_mode = false;
+    bool op_cost_mode = false;
+    bool ping_pong_mode = false;
+    unsigned int capacity = 1 << 16;
+    unsigned int quota = 0;
+    unsigned int wait_interval_us = 100;
+    unsigned int burst = 100;
+    bool notify_mode = false;
+    bool wait_mode = false;
+    bool n_elems_set = false;
+    enum placement placement = PLACEMENT_NONE;
+    const char *producer_cpu_list = NULL;
+    bool arrival_set = false;
     struct mpscq_aux aux;
     pthread_t *threads;
     size_t i;
@@ -201,16 +983,144 @@ run_benchmarks(int argc, const char *argv[])
     for (i = 1; i < (size_t)argc; i++) {
         if (!strcmp(argv[i], "-n")) {
             assert(str_to_uint(argv[++i], 10, &n_elems));
+            n_elems_set = true;
         } else if (!strcmp(argv[i], "-c")) {
             assert(str_to_uint(argv[++i], 10, &n_threads));
         } else if (!strcmp(argv[i], "--perf")) {
             only_mpsc_queue = true;
         } else if (!strcmp(argv[i], "--with-treiber-stack")) {
             with_treiber_stack = true;
+        } else if (!strcmp(argv[i], "--with-flat-combining")) {
+            with_flat_combining = true;
+        } else if (!strcmp(argv[i], "--with-bounded")) {
+            with_bounded = true;
+        } else if (!strcmp(argv[i], "--with-ring")) {
+            with_ring = true;
+        } else if (!strcmp(argv[i], "--with-segq")) {
+            with_segq = true;
+        } else if (!strcmp(argv[i], "--with-autobatch")) {
+            with_autobatch = true;
+        } else if (!strcmp(argv[i], "--with-padded")) {
+            with_padded = true;
+        } else if (!strcmp(argv[i], "--with-deferred")) {
+            with_deferred = true;
+        } else if (!strcmp(argv[i], "--with-sp")) {
+            with_sp = true;
+        } else if (!strcmp(argv[i], "--with-stats")) {
+            with_stats = true;
+        } else if (!strcmp(argv[i], "--stub-stats")) {
+            stub_stats = true;
+        } else if (!strcmp(argv[i], "--latency")) {
+            record_latency = true;
+        } else if (!strcmp(argv[i], "--perf-counters")) {
+            perf_counters = true;
+        } else if (!strcmp(argv[i], "--false-sharing")) {
+            false_sharing_mode = true;
+        } else if (!strcmp(argv[i], "--op-cost")) {
+            op_cost_mode = true;
+        } else if (!strcmp(argv[i], "--ping-pong")) {
+            ping_pong_mode = true;
+        } else if (!strcmp(argv[i], "--tailq-lock")) {
+            i++;
+            if (!tailq_locks_parse(argv[i], with_tailq_lock)) {
+                printf("Unknown tailq lock in '%s', use a list of "
+                       "mutex, spin, ticket, mcs, or all.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i], "--capacity")) {
+            assert(str_to_uint(argv[++i], 10, &capacity));
+        } else if (!strcmp(argv[i], "--quota")) {
+            assert(str_to_uint(argv[++i], 10, &quota));
+        } else if (!strcmp(argv[i], "--consumer-cpu")) {
+            unsigned int cpu;
+
+            assert(str_to_uint(argv[++i], 10, &cpu));
+            consumer_cpu = cpu;
+        } else if (!strcmp(argv[i], "--producer-cpus")) {
+            producer_cpu_list = argv[++i];
+        } else if (!strcmp(argv[i], "--placement")) {
+            i++;
+            if (!placement_from_string(argv[i], &placement)) {
+                printf("Unknown placement '%s', "
+                       "use one of smt, socket, cross-socket.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i], "--arrival")) {
+            i++;
+            if (!arrival_from_string(argv[i], &scenario.arrival)) {
+                printf("Unknown arrival '%s', "
+                       "use one of closed, poisson, burst.\n", argv[i]);
+                exit(1);
+            }
+            arrival_set = true;
+        } else if (!strcmp(argv[i], "--rate")) {
+            unsigned int rate;
+
+            assert(str_to_uint(argv[++i], 10, &rate));
+            scenario.rate = rate;
+        } else if (!strcmp(argv[i], "--skew")) {
+            char *end;
+
+            scenario.skew = strtod(argv[++i], &end);
+            assert(*end == '\0' && scenario.skew >= 0);
+        } else if (!strcmp(argv[i], "--work")) {
+            unsigned int work_ns;
+
+            assert(str_to_uint(argv[++i], 10, &work_ns));
+            scenario.work_ns = work_ns;
+        } else if (!strcmp(argv[i], "--stall")) {
+            assert(str_to_uint(argv[++i], 10, &scenario.stall_us));
+        } else if (!strcmp(argv[i], "--stall-every")) {
+            assert(str_to_uint(argv[++i], 10, &scenario.stall_every));
         } else if (!strcmp(argv[i], "--csv")) {
             print_csv = true;
         } else if (!strcmp(argv[i], "-b")) {
             assert(str_to_uint(argv[++i], 10, &batch_size));
+        } else if (!strcmp(argv[i], "-p")) {
+            assert(str_to_uint(argv[++i], 10, &pop_batch_size));
+        } else if (!strcmp(argv[i], "--take-all")) {
+            take_all = true;
+        } else if (!strcmp(argv[i], "--vtable")) {
+            use_vtable = true;
+        } else if (!strcmp(argv[i], "--alloc")) {
+            i++;
+            if (!strcmp(argv[i], "static")) {
+                alloc_mode = ALLOC_STATIC;
+            } else if (!strcmp(argv[i], "malloc")) {
+                alloc_mode = ALLOC_MALLOC;
+            } else if (!strcmp(argv[i], "pool")) {
+                alloc_mode = ALLOC_POOL;
+            } else {
+                printf("Unknown allocation mode '%s', "
+                       "use one of static, malloc, pool.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i], "--payload")) {
+            unsigned int size;
+
+            assert(str_to_uint(argv[++i], 10, &size));
+            payload_size = size;
+        } else if (!strcmp(argv[i], "--layout")) {
+            i++;
+            if (!strcmp(argv[i], "contiguous")) {
+                layout = LAYOUT_CONTIGUOUS;
+            } else if (!strcmp(argv[i], "shuffled")) {
+                layout = LAYOUT_SHUFFLED;
+            } else if (!strcmp(argv[i], "heap")) {
+                layout = LAYOUT_HEAP;
+            } else {
+                printf("Unknown layout '%s', "
+                       "use one of contiguous, shuffled, heap.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i], "--wait")) {
+            wait_mode = true;
+        } else if (!strcmp(argv[i], "--notify")) {
+            notify_mode = true;
+        } else if (!strcmp(argv[i], "--burst")) {
+            assert(str_to_uint(argv[++i], 10, &burst));
+        } else if (!strcmp(argv[i], "--wait-interval")) {
+            assert(str_to_uint(argv[++i], 10, &wait_interval_us));
         } else {
             printf("Usage: %s [-n <elems: uint>] [-c <cores: uint>]\n", argv[0]);
             exit(1);
@@ -223,10 +1133,103 @@ run_benchmarks(int argc, const char *argv[])
         batch_size = MAX_BATCH_SIZE;
     }
 
+    if (pop_batch_size > MAX_BATCH_SIZE) {
+        fprintf(stderr, "Using maximum allowed pop batch size: %u",
+                MAX_BATCH_SIZE);
+        pop_batch_size = MAX_BATCH_SIZE;
+    }
+
+    if (payload_size > MAX_PAYLOAD_SIZE) {
+        fprintf(stderr, "Using maximum allowed payload size: %u\n",
+                MAX_PAYLOAD_SIZE);
+        payload_size = MAX_PAYLOAD_SIZE;
+    }
+    payload_size = ROUND_UP(payload_size, sizeof(uint64_t));
+
+    /* Other allocation modes tell leftover elements apart by their
+     * address in the array. */
+    if (layout != LAYOUT_CONTIGUOUS && alloc_mode != ALLOC_STATIC) {
+        printf("--layout requires static allocation.\n");
+        exit(1);
+    }
+
+    /* A rate alone means Poisson arrivals. */
+    if (scenario.rate != 0 && !arrival_set) {
+        scenario.arrival = ARRIVAL_POISSON;
+    }
+    if (scenario.arrival != ARRIVAL_CLOSED && scenario.rate == 0) {
+        printf("--arrival %s requires a --rate.\n",
+               arrival_to_string(scenario.arrival));
+        exit(1);
+    }
+    scenario.burst = burst;
+    with_scenario = scenario_is_active(&scenario);
+
+    if (wait_mode) {
+        bench_wait(n_elems_set ? n_elems : 10000, wait_interval_us, print_csv);
+        return;
+    }
+
+    if (false_sharing_mode) {
+        bench_false_sharing(n_elems, n_threads, print_csv);
+        return;
+    }
+
+    if (op_cost_mode) {
+        struct mpscq *queues[] = { &mpsc_queue, &tailq };
+
+        bench_op_cost(queues, only_mpsc_queue ? 1 : ARRAY_SIZE(queues),
+                      n_elems, n_threads, batch_size, print_csv);
+        return;
+    }
+
+    if (ping_pong_mode) {
+        struct mpscq *queues[] = { &mpsc_queue, &tailq, &ts_mpsc_queue };
+
+        bench_ping_pong(queues, only_mpsc_queue ? 1 : ARRAY_SIZE(queues),
+                        n_elems_set ? n_elems : 100000, n_threads,
+                        print_csv);
+        return;
+    }
+
+    if (notify_mode) {
+        bench_notify(n_elems_set ? n_elems : 100000, burst,
+                     wait_interval_us, print_csv);
+        return;
+    }
+
+    /* Producers inherit the consumer CPU until they pin themselves. */
+    setup_placement(placement, producer_cpu_list);
+
+    /* Without any counter, run the benchmark without them. */
+    if (perf_counters && !perf_counters_open(&consumer_pc)) {
+        perf_counters = false;
+    }
+
     atomic_store(&aux.thread_id, 0);
 
-    elements = xcalloc(n_elems, sizeof *elements);
+    elements_alloc();
+    if (alloc_mode == ALLOC_POOL) {
+        pools = aligned_alloc(_Alignof(struct mpsc_queue_pool),
+                              n_threads * sizeof *pools);
+        if (pools == NULL) {
+            out_of_memory();
+        }
+        for (i = 0; i < n_threads; i++) {
+            mpsc_queue_pool_init(&pools[i],
+                                 sizeof(struct heap_element) + payload_size,
+                                 offsetof(struct heap_element, pnode));
+        }
+        mpsc_queue_pool_recycler_init(&recycler, batch_size);
+    }
     thread_working_ms = xcalloc(n_threads, sizeof *thread_working_ms);
+    shares = xcalloc(n_threads, sizeof *shares);
+    progress = aligned_alloc(MPSC_QUEUE_CACHE_LINE_SIZE,
+                             n_threads * sizeof *progress);
+    if (progress == NULL) {
+        out_of_memory();
+    }
+    compute_shares();
     threads = xmalloc(n_threads * sizeof *threads);
     pthread_barrier_init(&barrier, NULL, n_threads + 1);
     working = true;
@@ -234,37 +1237,113 @@ run_benchmarks(int argc, const char *argv[])
     for (i = 0; i < n_threads; i++) {
         pthread_create(&threads[i], NULL, producer_main, &aux);
     }
+    /* Wait for the producers to be placed. */
+    pthread_barrier_wait(&barrier);
 
     {
         unsigned int n_elems_memo = n_elems;
+        struct scenario scenario_memo = scenario;
+        bool with_scenario_memo = with_scenario;
 
+        /* Warm up at full speed. */
         warming = true;
         n_elems = MIN(n_elems, 100000);
+        scenario = (struct scenario) { .arrival = ARRIVAL_CLOSED };
+        with_scenario = false;
         benchmark_mpscq(&tailq, &aux);
         benchmark_mpscq(&tailq, &aux);
         benchmark_mpscq(&tailq, &aux);
         n_elems = n_elems_memo;
+        scenario = scenario_memo;
+        with_scenario = with_scenario_memo;
         warming = false;
     }
 
     print_header();
 
     benchmark_mpscq(&mpsc_queue, &aux);
+    if (with_padded) {
+        benchmark_mpscq(&mpsc_queue_padded, &aux);
+    }
+    /* Stub insertions are counted by the builds with statistics. */
+    if (with_stats || stub_stats) {
+        benchmark_mpscq(&mpsc_queue_with_stats, &aux);
+    }
+    if (with_deferred) {
+        /* The last node popped stays linked until the next pop. */
+        if (alloc_mode == ALLOC_STATIC) {
+            benchmark_mpscq(&mpsc_queue_deferred, &aux);
+            if (stub_stats) {
+                benchmark_mpscq(&mpsc_queue_deferred_with_stats, &aux);
+            }
+        } else {
+            fprintf(stderr, "%s requires static allocation, skipping.\n",
+                    mpsc_queue_deferred.desc);
+        }
+    }
+    if (with_sp) {
+        if (n_threads == 1 && alloc_mode == ALLOC_STATIC) {
+            benchmark_mpscq(&mpsc_queue_sp, &aux);
+        } else {
+            fprintf(stderr, "%s requires a single producer (-c 1) "
+                    "and static allocation, skipping.\n", mpsc_queue_sp.desc);
+        }
+    }
+    if (with_bounded) {
+        /* A batch must fit in the capacity and in the quota. */
+        mpscq_bounded_configure(MAX(capacity, n_threads * batch_size),
+                                quota ? MAX(quota, batch_size) : 0);
+        benchmark_mpscq(&mpsc_queue_bounded, &aux);
+    }
+    if (with_ring) {
+        mpscq_ring_configure(MAX(capacity, n_threads * batch_size));
+        benchmark_mpscq(&mpsc_ring, &aux);
+    }
+    if (with_segq) {
+        benchmark_mpscq(&mpsc_segq, &aux);
+    }
+    if (with_autobatch) {
+        benchmark_mpscq(&mpsc_queue_autobatch, &aux);
+    }
     if (!only_mpsc_queue) {
-        benchmark_mpscq(&tailq, &aux);
+        for (i = 0; i < ARRAY_SIZE(tailq_locks); i++) {
+            if (with_tailq_lock[i]) {
+                benchmark_mpscq(tailq_locks[i].queue, &aux);
+            }
+        }
         if (with_treiber_stack) {
             benchmark_mpscq(&ts_mpsc_queue, &aux);
         }
+        if (with_flat_combining) {
+            benchmark_mpscq(&fc_mpsc_queue, &aux);
+        }
     }
     working = false;
     pthread_barrier_wait(&barrier);
 
+    if (with_stats && !print_csv) {
+        printf("\n");
+        mpscq_stats_dump(stdout);
+    }
+
     for (i = 0; i < n_threads; i++) {
         pthread_join(threads[i], NULL);
     }
 
+    if (pools != NULL) {
+        for (i = 0; i < n_threads; i++) {
+            mpsc_queue_pool_destroy(&pools[i]);
+        }
+        free(pools);
+    }
+    if (perf_counters) {
+        perf_counters_close(&consumer_pc);
+    }
+    free(producer_cpus);
+    free(progress);
+    free(shares);
     free(thread_working_ms);
-    free(elements);
+    elements_free();
     free(threads);
 }
 
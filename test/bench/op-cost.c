@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <pthread.h>
+#if __APPLE__
+#include "pthread-barrier.h"
+#endif
+
+#include "bench.h"
+#include "histogram.h"
+#include "mpscq.h"
+#include "tsc.h"
+#include "util.h"
+
+#define OP_COST_MAX_BATCH 64
+
+enum op_cost_op {
+    OP_INSERT,
+    OP_INSERT_BATCH,
+    OP_POP,
+    OP_N,
+};
+
+static const char *op_names[OP_N] = {
+    [OP_INSERT] = "insert",
+    [OP_INSERT_BATCH] = "insert-batch",
+    [OP_POP] = "pop",
+};
+
+struct op_cost_ctx {
+    struct mpscq *queue;
+    union mpscq_node *nodes;
+    unsigned int n_threads;
+    unsigned int n_per_thread;
+    unsigned int batch_size;
+    /* Producers insert nodes one by one, or by batches. */
+    bool batched;
+    pthread_barrier_t barrier;
+    _Atomic(unsigned int) next_id;
+    /* One histogram per producer. */
+    struct histogram *insert_cost;
+    struct histogram pop_cost;
+};
+
+static void *
+op_cost_producer_main(void *aux)
+{
+    union mpscq_node *batch[OP_COST_MAX_BATCH];
+    struct op_cost_ctx *ctx = aux;
+    union mpscq_node *nodes;
+    struct histogram *h;
+    uint64_t start, end;
+    unsigned int id;
+    unsigned int n;
+
+    id = atomic_fetch_add(&ctx->next_id, 1u);
+    nodes = &ctx->nodes[id * ctx->n_per_thread];
+    h = &ctx->insert_cost[id];
+
+    pthread_barrier_wait(&ctx->barrier);
+
+    n = 0;
+    if (ctx->batched) {
+        while (n + ctx->batch_size <= ctx->n_per_thread) {
+            for (size_t j = 0; j < ctx->batch_size; j++) {
+                batch[j] = &nodes[n++];
+            }
+            start = tsc_read();
+            mpscq_insert_batch(ctx->queue, ctx->batch_size, batch);
+            end = tsc_read();
+            histogram_record(h, tsc_delta_ns(start, end));
+        }
+    }
+    /* Leftovers of the batched run are inserted without timing. */
+    while (n < ctx->n_per_thread) {
+        start = tsc_read();
+        mpscq_insert(ctx->queue, &nodes[n++]);
+        end = tsc_read();
+        if (!ctx->batched) {
+            histogram_record(h, tsc_delta_ns(start, end));
+        }
+    }
+    mpscq_flush(ctx->queue);
+
+    return NULL;
+}
+
+static void
+op_cost_consume(struct op_cost_ctx *ctx)
+{
+    unsigned int n_total = ctx->n_threads * ctx->n_per_thread;
+    union mpscq_node *node;
+    uint64_t start, end;
+    unsigned int n = 0;
+
+    /* Only pops returning a node are recorded. */
+    while (n < n_total) {
+        start = tsc_read();
+        node = mpscq_pop(ctx->queue);
+        end = tsc_read();
+        if (node != NULL) {
+            histogram_record(&ctx->pop_cost, tsc_delta_ns(start, end));
+            n++;
+        }
+    }
+}
+
+static void
+op_cost_run(struct op_cost_ctx *ctx)
+{
+    pthread_t *threads = xcalloc(ctx->n_threads, sizeof *threads);
+
+    mpscq_init(ctx->queue);
+    atomic_store(&ctx->next_id, 0);
+    pthread_barrier_init(&ctx->barrier, NULL, ctx->n_threads + 1);
+    for (unsigned int i = 0; i < ctx->n_threads; i++) {
+        pthread_create(&threads[i], NULL, op_cost_producer_main, ctx);
+    }
+
+    pthread_barrier_wait(&ctx->barrier);
+    op_cost_consume(ctx);
+
+    for (unsigned int i = 0; i < ctx->n_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&ctx->barrier);
+    free(threads);
+}
+
+static void
+op_cost_print(struct mpscq *q, unsigned int n_threads, enum op_cost_op op,
+              const struct histogram *h, bool csv)
+{
+    static const struct {
+        const char *name;
+        double pct;
+    } percentiles[] = {
+        { "p50", 50 },
+        { "p90", 90 },
+        { "p99", 99 },
+        { "p99.9", 99.9 },
+        { "max", 100 },
+    };
+
+    if (!csv) {
+        printf("%20s %3u %12s:", q->desc, n_threads, op_names[op]);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        uint64_t value = histogram_percentile(h, percentiles[i].pct);
+
+        if (csv) {
+            printf("op-cost-%s-%u-%s-%s-ns,%" PRIu64 "\n", q->desc,
+                   n_threads, op_names[op], percentiles[i].name, value);
+        } else {
+            printf(" %8" PRIu64, value);
+        }
+    }
+    if (!csv) {
+        printf("\n");
+    }
+}
+
+static void
+op_cost_queue(struct mpscq *q, unsigned int n_msgs, unsigned int n_threads,
+              unsigned int batch_size, bool csv)
+{
+    struct histogram *insert_cost[OP_N] = { NULL };
+    struct op_cost_ctx ctx;
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.queue = q;
+    ctx.n_threads = n_threads;
+    ctx.n_per_thread = n_msgs / n_threads;
+    ctx.batch_size = batch_size;
+    ctx.nodes = xcalloc(n_threads * ctx.n_per_thread, sizeof *ctx.nodes);
+    ctx.insert_cost = xcalloc(n_threads, sizeof *ctx.insert_cost);
+    histogram_init(&ctx.pop_cost);
+
+    /* Single insertions, then batches. Pops of both runs are merged. */
+    for (int batched = 0; batched <= 1; batched++) {
+        enum op_cost_op op = batched ? OP_INSERT_BATCH : OP_INSERT;
+
+        ctx.batched = batched;
+        for (unsigned int i = 0; i < n_threads; i++) {
+            histogram_init(&ctx.insert_cost[i]);
+        }
+        op_cost_run(&ctx);
+
+        insert_cost[op] = xmalloc(sizeof *insert_cost[op]);
+        histogram_init(insert_cost[op]);
+        for (unsigned int i = 0; i < n_threads; i++) {
+            histogram_merge(insert_cost[op], &ctx.insert_cost[i]);
+        }
+    }
+
+    op_cost_print(q, n_threads, OP_INSERT, insert_cost[OP_INSERT], csv);
+    op_cost_print(q, n_threads, OP_INSERT_BATCH,
+                  insert_cost[OP_INSERT_BATCH], csv);
+    op_cost_print(q, n_threads, OP_POP, &ctx.pop_cost, csv);
+
+    free(insert_cost[OP_INSERT]);
+    free(insert_cost[OP_INSERT_BATCH]);
+    free(ctx.insert_cost);
+    free(ctx.nodes);
+}
+
+void
+bench_op_cost(struct mpscq *queues[], size_t n_queues, unsigned int n_msgs,
+              unsigned int max_threads, unsigned int batch_size, bool csv)
+{
+    unsigned int n_threads;
+
+    batch_size = MAX(MIN(batch_size, OP_COST_MAX_BATCH), 1u);
+    max_threads = MAX(max_threads, 1u);
+    tsc_calibrate();
+
+    if (!csv) {
+        printf("Benchmarking operation cost, n=%u,batch=%u, "
+               "timer at %.3f GHz.\n", n_msgs, batch_size, tsc_hz() / 1e9);
+        printf("%20s %3s %12s: %8s %8s %8s %8s %8s ns\n", "type", "thr", "op",
+               "p50", "p90", "p99", "p99.9", "max");
+    }
+
+    /* Powers of two, then the requested number of threads. */
+    for (n_threads = 1; ; n_threads = MIN(n_threads * 2, max_threads)) {
+        for (size_t i = 0; i < n_queues; i++) {
+            op_cost_queue(queues[i], n_msgs, n_threads, batch_size, csv);
+        }
+        if (n_threads == max_threads) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf-counters.h"
+
+const char *perf_counter_names[PERF_COUNTER_N] = {
+    [PERF_COUNTER_CYCLES] = "cycles",
+    [PERF_COUNTER_INSTRUCTIONS] = "instructions",
+    [PERF_COUNTER_CACHE_REFERENCES] = "cache-references",
+    [PERF_COUNTER_CACHE_MISSES] = "cache-misses",
+    [PERF_COUNTER_L1D_MISSES] = "l1d-misses",
+};
+
+void
+perf_values_reset(struct perf_values *sum)
+{
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        atomic_store_explicit(&sum->values[i], 0, memory_order_relaxed);
+    }
+}
+
+bool
+perf_counter_available(const struct perf_counters *pc,
+                       enum perf_counter_id id)
+{
+    return pc->fds[id] >= 0;
+}
+
+#ifdef __linux__
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_events[PERF_COUNTER_N] = {
+    [PERF_COUNTER_CYCLES] = {
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_COUNTER_INSTRUCTIONS] = {
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_COUNTER_CACHE_REFERENCES] = {
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    [PERF_COUNTER_CACHE_MISSES] = {
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [PERF_COUNTER_L1D_MISSES] = {
+        PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+/* Value, time enabled, time running. */
+struct perf_read_format {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+static int
+perf_event_open(struct perf_event_attr *attr)
+{
+    /* This thread, any CPU, no group. */
+    return syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+bool
+perf_counters_open(struct perf_counters *pc)
+{
+    static atomic_flag warned = ATOMIC_FLAG_INIT;
+    bool any = false;
+    int err = 0;
+
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = perf_events[i].type;
+        attr.config = perf_events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        pc->fds[i] = perf_event_open(&attr);
+        if (pc->fds[i] < 0) {
+            err = errno;
+        } else {
+            any = true;
+        }
+    }
+
+    if (!any && !atomic_flag_test_and_set(&warned)) {
+        fprintf(stderr, "perf counters unavailable: %s%s\n", strerror(err),
+                err == EACCES || err == EPERM
+                ? " (see /proc/sys/kernel/perf_event_paranoid)" : "");
+    }
+    return any;
+}
+
+void
+perf_counters_close(struct perf_counters *pc)
+{
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        if (pc->fds[i] >= 0) {
+            close(pc->fds[i]);
+            pc->fds[i] = -1;
+        }
+    }
+}
+
+void
+perf_counters_start(struct perf_counters *pc)
+{
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        if (pc->fds[i] >= 0) {
+            ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void
+perf_counters_stop(struct perf_counters *pc, struct perf_values *sum)
+{
+    struct perf_read_format rf;
+
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        if (pc->fds[i] >= 0) {
+            ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        uint64_t value;
+
+        if (pc->fds[i] < 0 ||
+            read(pc->fds[i], &rf, sizeof rf) != sizeof rf ||
+            rf.time_running == 0) {
+            continue;
+        }
+        value = rf.value;
+        if (rf.time_running < rf.time_enabled) {
+            value = (double) value * rf.time_enabled / rf.time_running;
+        }
+        atomic_fetch_add_explicit(&sum->values[i], value,
+                                  memory_order_relaxed);
+    }
+}
+
+#else
+
+bool
+perf_counters_open(struct perf_counters *pc)
+{
+    static atomic_flag warned = ATOMIC_FLAG_INIT;
+
+    for (size_t i = 0; i < PERF_COUNTER_N; i++) {
+        pc->fds[i] = -1;
+    }
+    if (!atomic_flag_test_and_set(&warned)) {
+        fprintf(stderr, "perf counters are only available on Linux.\n");
+    }
+    return false;
+}
+
+void
+perf_counters_close(struct perf_counters *pc)
+{
+    (void) pc;
+}
+
+void
+perf_counters_start(struct perf_counters *pc)
+{
+    (void) pc;
+}
+
+void
+perf_counters_stop(struct perf_counters *pc, struct perf_values *sum)
+{
+    (void) pc;
+    (void) sum;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Hardware counters of the calling thread, through perf_event_open(2).
+ *
+ * Counters that cannot be opened, because the system does not allow it
+ * (perf_event_paranoid, containers) or the CPU does not support them,
+ * are reported as unavailable, and the others still work. On systems
+ * other than Linux, none is available. */
+
+enum perf_counter_id {
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_CACHE_REFERENCES,
+    PERF_COUNTER_CACHE_MISSES,
+    PERF_COUNTER_L1D_MISSES,
+    PERF_COUNTER_N,
+};
+
+extern const char *perf_counter_names[PERF_COUNTER_N];
+
+struct perf_counters {
+    int fds[PERF_COUNTER_N];
+};
+
+/* Totals, possibly summed over several threads. */
+struct perf_values {
+    _Atomic(uint64_t) values[PERF_COUNTER_N];
+};
+
+/* Open the counters of the calling thread, disabled.
+ * Returns false if none could be opened. The reason is printed
+ * once per process. */
+bool perf_counters_open(struct perf_counters *pc);
+void perf_counters_close(struct perf_counters *pc);
+
+bool perf_counter_available(const struct perf_counters *pc,
+                            enum perf_counter_id id);
+
+/* Reset and enable the counters. */
+void perf_counters_start(struct perf_counters *pc);
+
+/* Disable the counters and add their values to 'sum'. Values are
+ * scaled if the kernel had to multiplex the counters. */
+void perf_counters_stop(struct perf_counters *pc, struct perf_values *sum);
+
+void perf_values_reset(struct perf_values *sum);
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <sched.h>
+
+#include <pthread.h>
+#if __APPLE__
+#include "pthread-barrier.h"
+#endif
+
+#include "bench.h"
+#include "histogram.h"
+#include "mpscq.h"
+#include "util.h"
+
+/* Empty polls before yielding the CPU. */
+#define PING_PONG_SPIN 1024
+
+struct ping_pong_msg {
+    union mpscq_node node;
+    unsigned int client;
+    uint64_t sent_ns;
+};
+
+struct ping_pong_ctx {
+    /* Requests, from all clients. */
+    struct mpscq server;
+    /* Replies, one queue per client. */
+    struct mpscq *replies;
+    unsigned int n_clients;
+    unsigned int n_msgs;
+    /* Round trips not recorded, at the beginning. */
+    unsigned int n_warmup;
+    pthread_barrier_t barrier;
+    _Atomic(unsigned int) next_id;
+    /* One histogram per client. */
+    struct histogram *rtt;
+};
+
+static union mpscq_node *
+ping_pong_pop(struct mpscq *q)
+{
+    union mpscq_node *node;
+    unsigned int n = 0;
+
+    while ((node = mpscq_pop(q)) == NULL) {
+        if (++n % PING_PONG_SPIN == 0) {
+            sched_yield();
+        }
+    }
+    return node;
+}
+
+static void *
+ping_pong_client_main(void *aux)
+{
+    struct ping_pong_ctx *ctx = aux;
+    struct ping_pong_msg msg;
+    struct mpscq *replies;
+    struct histogram *h;
+    unsigned int id;
+
+    id = atomic_fetch_add(&ctx->next_id, 1u);
+    replies = &ctx->replies[id];
+    h = &ctx->rtt[id];
+    memset(&msg, 0, sizeof msg);
+    msg.client = id;
+
+    pthread_barrier_wait(&ctx->barrier);
+
+    for (unsigned int i = 0; i < ctx->n_warmup + ctx->n_msgs; i++) {
+        uint64_t rtt;
+
+        msg.sent_ns = time_nsec();
+        mpscq_insert(&ctx->server, &msg.node);
+        ping_pong_pop(replies);
+        rtt = time_nsec() - msg.sent_ns;
+        if (i >= ctx->n_warmup) {
+            histogram_record(h, rtt);
+        }
+    }
+
+    return NULL;
+}
+
+static void
+ping_pong_server(struct ping_pong_ctx *ctx)
+{
+    unsigned int n = (ctx->n_warmup + ctx->n_msgs) * ctx->n_clients;
+
+    pthread_barrier_wait(&ctx->barrier);
+
+    while (n-- > 0) {
+        union mpscq_node *node = ping_pong_pop(&ctx->server);
+        struct ping_pong_msg *msg;
+
+        msg = container_of(node, struct ping_pong_msg, node);
+        mpscq_insert(&ctx->replies[msg->client], &msg->node);
+    }
+}
+
+static void
+print_ping_pong_result(struct mpscq *q, unsigned int n_clients,
+                       struct histogram *rtt, bool csv)
+{
+    static const struct {
+        const char *name;
+        double pct;
+    } percentiles[] = {
+        { "p50", 50 },
+        { "p90", 90 },
+        { "p99", 99 },
+        { "p99.9", 99.9 },
+        { "max", 100 },
+    };
+
+    if (!csv) {
+        printf("%*s: %7u", 20, q->desc, n_clients);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        uint64_t value = histogram_percentile(rtt, percentiles[i].pct);
+
+        if (csv) {
+            printf("ping-pong-%s-%u-rtt-%s-ns,%" PRIu64 "\n",
+                   q->desc, n_clients, percentiles[i].name, value);
+        } else {
+            printf(" %8" PRIu64, value);
+        }
+    }
+    if (!csv) {
+        printf("\n");
+    }
+}
+
+static void
+ping_pong_run(struct mpscq *q, unsigned int n_msgs, unsigned int n_clients,
+              bool csv)
+{
+    struct ping_pong_ctx ctx;
+    struct histogram rtt;
+    pthread_t *clients;
+    unsigned int i;
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.replies = xcalloc(n_clients, sizeof *ctx.replies);
+    ctx.rtt = xcalloc(n_clients, sizeof *ctx.rtt);
+    if (!mpscq_instance_new(q, &ctx.server)) {
+        out_of_memory();
+    }
+    for (i = 0; i < n_clients; i++) {
+        if (!mpscq_instance_new(q, &ctx.replies[i])) {
+            out_of_memory();
+        }
+        histogram_init(&ctx.rtt[i]);
+    }
+    ctx.n_clients = n_clients;
+    ctx.n_msgs = n_msgs;
+    ctx.n_warmup = n_msgs / 10;
+    pthread_barrier_init(&ctx.barrier, NULL, n_clients + 1);
+    atomic_store(&ctx.next_id, 0);
+
+    clients = xmalloc(n_clients * sizeof *clients);
+    for (i = 0; i < n_clients; i++) {
+        pthread_create(&clients[i], NULL, ping_pong_client_main, &ctx);
+    }
+    ping_pong_server(&ctx);
+    for (i = 0; i < n_clients; i++) {
+        pthread_join(clients[i], NULL);
+    }
+
+    histogram_init(&rtt);
+    for (i = 0; i < n_clients; i++) {
+        histogram_merge(&rtt, &ctx.rtt[i]);
+    }
+    print_ping_pong_result(q, n_clients, &rtt, csv);
+
+    pthread_barrier_destroy(&ctx.barrier);
+    for (i = 0; i < n_clients; i++) {
+        mpscq_instance_free(&ctx.replies[i]);
+    }
+    mpscq_instance_free(&ctx.server);
+    free(clients);
+    free(ctx.replies);
+    free(ctx.rtt);
+}
+
+void
+bench_ping_pong(struct mpscq *queues[], size_t n_queues,
+                unsigned int n_msgs, unsigned int n_clients, bool csv)
+{
+    if (!csv) {
+        printf("Benchmarking round trips, n=%u per client.\n", n_msgs);
+        printf("%*s: %7s %8s %8s %8s %8s %8s ns\n", 20, "type",
+               "clients", "p50", "p90", "p99", "p99.9", "max");
+    }
+
+    for (size_t i = 0; i < n_queues; i++) {
+        if (!mpscq_has_instances(queues[i])) {
+            fprintf(stderr, "%s cannot have several instances, "
+                    "skipping.\n", queues[i]->desc);
+            continue;
+        }
+        ping_pong_run(queues[i], n_msgs, 1, csv);
+        if (n_clients > 1) {
+            ping_pong_run(queues[i], n_msgs, n_clients, csv);
+        }
+    }
+}
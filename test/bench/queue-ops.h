@@ -0,0 +1,146 @@
+#ifndef QUEUE_OPS_H
+#define QUEUE_OPS_H
+
+#include <stddef.h>
+
+#include "mpscq.h"
+#include "util.h"
+
+/* Operations of some queues, with the signatures of the 'mpscq_*'
+ * functions but calling the queue directly instead of through the
+ * 'struct mpscq' vtable. Loops given them as constant arguments are
+ * compiled with the operations inlined.
+ *
+ * Only valid on the queue of the same type: 'mpsc_queue', not its
+ * padded or instrumented builds, whose layout or counters differ. */
+
+/* mpsc-queue. */
+
+static inline void
+mpsc_queue_insert_op(struct mpscq *q, union mpscq_node *node)
+{
+    mpsc_queue_insert(from_mpscq(q->handle), &node->dv);
+}
+
+static inline void
+mpsc_queue_insert_batch_op(struct mpscq *q, size_t n_nodes,
+                           union mpscq_node *node_ptrs[n_nodes])
+{
+    /* Linked here, without first copying the node pointers. */
+    for (size_t i = 0; i < n_nodes - 1; i++) {
+        atomic_store_explicit(&node_ptrs[i]->dv.next, &node_ptrs[i + 1]->dv,
+                              memory_order_relaxed);
+    }
+    mpsc_queue_insert_list(from_mpscq(q->handle), &node_ptrs[0]->dv,
+                           &node_ptrs[n_nodes - 1]->dv);
+}
+
+static inline union mpscq_node *
+mpsc_queue_pop_op(struct mpscq *q)
+{
+    struct mpsc_queue_node *node = mpsc_queue_pop(from_mpscq(q->handle));
+
+    return node ? container_of(node, union mpscq_node, dv) : NULL;
+}
+
+static inline size_t
+mpsc_queue_pop_batch_op(struct mpscq *q, size_t n_nodes,
+                        union mpscq_node *nodes[n_nodes])
+{
+    struct mpsc_queue *queue = from_mpscq(q->handle);
+    struct mpsc_queue_node *node;
+    size_t n = 0;
+
+    /* Stops where 'mpsc_queue_pop_batch' does, but converts the nodes
+     * in place instead of copying them from a batch of queue nodes. */
+    while (n < n_nodes
+           && mpsc_queue_poll(queue, &node) == MPSC_QUEUE_ITEM) {
+        nodes[n++] = container_of(node, union mpscq_node, dv);
+    }
+    return n;
+}
+
+/* tailq. */
+
+static inline void
+tailq_insert_op(struct mpscq *q, union mpscq_node *node)
+{
+    tailq_insert(from_mpscq(q->handle), &node->tailq);
+}
+
+static inline void
+tailq_insert_batch_op(struct mpscq *q, size_t n_nodes,
+                      union mpscq_node *node_ptrs[n_nodes])
+{
+    struct tailq_list batch;
+
+    TAILQ_INIT(&batch);
+    for (size_t i = 0; i < n_nodes; i++) {
+        TAILQ_INSERT_TAIL(&batch, &node_ptrs[i]->tailq, node);
+    }
+    tailq_insert_list(from_mpscq(q->handle), &batch);
+}
+
+static inline union mpscq_node *
+tailq_pop_op(struct mpscq *q)
+{
+    struct tailq_node *node = tailq_pop(from_mpscq(q->handle));
+
+    return node ? container_of(node, union mpscq_node, tailq) : NULL;
+}
+
+static inline size_t
+tailq_pop_batch_op(struct mpscq *q, size_t n_nodes,
+                   union mpscq_node *nodes[n_nodes])
+{
+    struct tailq *tq = from_mpscq(q->handle);
+    struct tailq_node *node;
+    size_t n = 0;
+
+    tailq_refill(tq);
+    while (n < n_nodes && !TAILQ_EMPTY(&tq->clist)) {
+        node = TAILQ_FIRST(&tq->clist);
+        TAILQ_REMOVE(&tq->clist, node, node);
+        nodes[n++] = container_of(node, union mpscq_node, tailq);
+    }
+    return n;
+}
+
+/* Treiber stack. */
+
+static inline void
+ts_mpsc_queue_insert_op(struct mpscq *q, union mpscq_node *node)
+{
+    ts_mpsc_queue_insert(from_mpscq(q->handle), &node->ts);
+}
+
+static inline void
+ts_mpsc_queue_insert_batch_op(struct mpscq *q, size_t n_nodes,
+                              union mpscq_node *node_ptrs[n_nodes])
+{
+    for (size_t i = 0; i < n_nodes; i++) {
+        ts_mpsc_queue_insert_op(q, node_ptrs[i]);
+    }
+}
+
+static inline union mpscq_node *
+ts_mpsc_queue_pop_op(struct mpscq *q)
+{
+    struct ts_mpsc_queue_node *node = ts_mpsc_queue_pop(from_mpscq(q->handle));
+
+    return node ? container_of(node, union mpscq_node, ts) : NULL;
+}
+
+static inline size_t
+ts_mpsc_queue_pop_batch_op(struct mpscq *q, size_t n_nodes,
+                           union mpscq_node *nodes[n_nodes])
+{
+    size_t n = 0;
+
+    while (n < n_nodes && (nodes[n] = ts_mpsc_queue_pop_op(q)) != NULL) {
+        n++;
+    }
+    return n;
+}
+
+#endif /* QUEUE_OPS_H */
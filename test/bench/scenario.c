@@ -0,0 +1,136 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "scenario.h"
+#include "util.h"
+
+/* Below this delay, waiting is done by spinning. */
+#define PACER_SPIN_NS (50 * 1000)
+
+static const char *arrival_names[] = {
+    [ARRIVAL_CLOSED] = "closed",
+    [ARRIVAL_POISSON] = "poisson",
+    [ARRIVAL_BURST] = "burst",
+};
+
+bool
+arrival_from_string(const char *s, enum arrival *arrival)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(arrival_names); i++) {
+        if (!strcmp(s, arrival_names[i])) {
+            *arrival = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+arrival_to_string(enum arrival arrival)
+{
+    return arrival_names[arrival];
+}
+
+bool
+scenario_is_active(const struct scenario *s)
+{
+    return (s->arrival != ARRIVAL_CLOSED && s->rate != 0) ||
+           s->skew != 0 || s->work_ns != 0 ||
+           (s->stall_us != 0 && s->stall_every != 0);
+}
+
+void
+scenario_shares(const struct scenario *s, unsigned int n,
+                unsigned int n_producers, unsigned int counts[])
+{
+    double sum = 0;
+
+    if (s->skew == 0) {
+        for (unsigned int i = 0; i < n_producers; i++) {
+            counts[i] = n / n_producers;
+        }
+        return;
+    }
+
+    for (unsigned int i = 0; i < n_producers; i++) {
+        sum += pow(i + 1, -s->skew);
+    }
+    for (unsigned int i = 0; i < n_producers; i++) {
+        counts[i] = n * (pow(i + 1, -s->skew) / sum);
+    }
+}
+
+static void
+spin_until(long long int deadline)
+{
+    long long int now;
+
+    while ((now = time_nsec()) < deadline) {
+        if (deadline - now > PACER_SPIN_NS) {
+            struct timespec pause = {
+                .tv_nsec = deadline - now - PACER_SPIN_NS / 2,
+            };
+
+            if (pause.tv_nsec >= 1000 * 1000 * 1000) {
+                pause.tv_sec = pause.tv_nsec / (1000 * 1000 * 1000);
+                pause.tv_nsec %= 1000 * 1000 * 1000;
+            }
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+void
+scenario_consume(const struct scenario *s, unsigned int n_processed)
+{
+    if (s->work_ns != 0) {
+        spin_until(time_nsec() + s->work_ns);
+    }
+    if (s->stall_us != 0 && s->stall_every != 0 &&
+        n_processed % s->stall_every == 0) {
+        struct timespec pause = {
+            .tv_sec = s->stall_us / (1000 * 1000),
+            .tv_nsec = (s->stall_us % (1000 * 1000)) * 1000,
+        };
+
+        nanosleep(&pause, NULL);
+    }
+}
+
+void
+pacer_init(struct pacer *p, const struct scenario *s,
+           unsigned int count, unsigned int total, uint32_t seed)
+{
+    p->arrival = s->rate != 0 ? s->arrival : ARRIVAL_CLOSED;
+    p->burst = MAX(s->burst, 1u);
+    p->interval_ns = 0;
+    if (p->arrival != ARRIVAL_CLOSED && count != 0) {
+        /* Each producer gets the part of the rate matching its share. */
+        p->interval_ns = 1e9 * total / ((double) s->rate * count);
+    }
+    p->next_ns = time_nsec();
+    p->seed = seed ? seed : 1;
+}
+
+unsigned int
+pacer_wait(struct pacer *p)
+{
+    double u;
+
+    switch (p->arrival) {
+    case ARRIVAL_POISSON:
+        /* In ]0, 1[, xorshift32 never returns 0. */
+        u = xorshift32(&p->seed) / 4294967296.0;
+        p->next_ns += -log(u) * p->interval_ns;
+        spin_until(p->next_ns);
+        return 1;
+    case ARRIVAL_BURST:
+        p->next_ns += p->burst * p->interval_ns;
+        spin_until(p->next_ns);
+        return p->burst;
+    case ARRIVAL_CLOSED:
+    default:
+        return UINT32_MAX;
+    }
+}
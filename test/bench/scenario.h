@@ -0,0 +1,70 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Shape of the load applied to the queues.
+ *
+ * By default, producers insert their share of messages as fast as
+ * they can and the consumer does nothing with them. A scenario paces
+ * the producers, splits messages unevenly between them, and gives
+ * the consumer work to do or stalls to go through. */
+
+enum arrival {
+    /* As fast as possible. */
+    ARRIVAL_CLOSED,
+    /* Exponential inter-arrival times. */
+    ARRIVAL_POISSON,
+    /* Bursts of messages, spaced evenly. */
+    ARRIVAL_BURST,
+};
+
+struct scenario {
+    enum arrival arrival;
+    /* Messages per second, summed over all producers. */
+    uint64_t rate;
+    unsigned int burst;
+    /* Exponent of the Zipf law giving the producer shares,
+     * 0 for even shares. */
+    double skew;
+    /* Consumer processing time per message. */
+    uint64_t work_ns;
+    /* The consumer stalls for 'stall_us' every 'stall_every' messages. */
+    unsigned int stall_us;
+    unsigned int stall_every;
+};
+
+/* Paces the insertions of one producer. */
+struct pacer {
+    enum arrival arrival;
+    unsigned int burst;
+    /* Mean time between two messages. */
+    double interval_ns;
+    double next_ns;
+    uint32_t seed;
+};
+
+bool arrival_from_string(const char *s, enum arrival *arrival);
+const char *arrival_to_string(enum arrival arrival);
+
+/* Whether the scenario differs from the closed, even load. */
+bool scenario_is_active(const struct scenario *s);
+
+/* Split 'n' messages between producers. Counts can sum to less
+ * than 'n', by less than 'n_producers'. */
+void scenario_shares(const struct scenario *s, unsigned int n,
+                     unsigned int n_producers, unsigned int counts[]);
+
+/* Consumer side, for each message processed. */
+void scenario_consume(const struct scenario *s, unsigned int n_processed);
+
+/* Pace 'count' messages out of 'total', starting now. */
+void pacer_init(struct pacer *p, const struct scenario *s,
+                unsigned int count, unsigned int total, uint32_t seed);
+
+/* Wait for the next arrival. Returns the number of messages
+ * arriving together. */
+unsigned int pacer_wait(struct pacer *p);
+
+#endif /* SCENARIO_H */
@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "mpsc-queue-wait.h"
+#include "bench.h"
+#include "util.h"
+
+struct wait_element {
+    struct mpsc_queue_node node;
+    long long int sent_ns;
+};
+
+struct wait_ctx {
+    struct mpsc_queue queue;
+    struct mpsc_queue_waiter waiter;
+    struct wait_element *elements;
+    unsigned int n_msgs;
+    unsigned int interval_us;
+    /* Results. */
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+    long long int cpu_ns;
+    long long int wall_ns;
+    unsigned int n_timeouts;
+};
+
+static const char *wait_strategy_names[] = {
+    [MPSC_QUEUE_WAIT_SPIN] = "spin",
+    [MPSC_QUEUE_WAIT_YIELD] = "yield",
+    [MPSC_QUEUE_WAIT_PARK] = "park",
+};
+
+static long long int
+thread_cpu_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return timespec_to_nsec(&ts);
+}
+
+static void *
+wait_consumer_main(void *aux)
+{
+    struct wait_ctx *ctx = aux;
+    struct mpsc_queue_node *node;
+    struct timespec deadline;
+    long long int start_cpu;
+    long long int start;
+    unsigned int n = 0;
+
+    start = time_nsec();
+    start_cpu = thread_cpu_nsec();
+
+    while (n < ctx->n_msgs) {
+        struct wait_element *e;
+        uint64_t latency;
+
+        xclock_gettime(&deadline);
+        deadline.tv_sec += 1;
+        node = mpsc_queue_pop_wait(&ctx->queue, &ctx->waiter, &deadline);
+        if (node == NULL) {
+            ctx->n_timeouts++;
+            continue;
+        }
+
+        e = container_of(node, struct wait_element, node);
+        latency = time_nsec() - e->sent_ns;
+        ctx->latency_sum_ns += latency;
+        ctx->latency_max_ns = MAX(ctx->latency_max_ns, latency);
+        n++;
+    }
+
+    ctx->cpu_ns = thread_cpu_nsec() - start_cpu;
+    ctx->wall_ns = time_nsec() - start;
+
+    return NULL;
+}
+
+static void
+wait_producer(struct wait_ctx *ctx)
+{
+    struct timespec pause = {
+        .tv_sec = ctx->interval_us / (1000 * 1000),
+        .tv_nsec = (ctx->interval_us % (1000 * 1000)) * 1000,
+    };
+
+    for (unsigned int i = 0; i < ctx->n_msgs; i++) {
+        struct wait_element *e = &ctx->elements[i];
+
+        nanosleep(&pause, NULL);
+        e->sent_ns = time_nsec();
+        if (mpsc_queue_insert(&ctx->queue, &e->node)) {
+            mpsc_queue_waiter_wake(&ctx->waiter);
+        }
+    }
+}
+
+static void
+print_wait_result(struct wait_ctx *ctx, enum mpsc_queue_wait_strategy s,
+                  bool csv)
+{
+    const char *name = wait_strategy_names[s];
+    uint64_t cpu_pct;
+    uint64_t avg;
+
+    avg = ctx->latency_sum_ns / ctx->n_msgs;
+    cpu_pct = ctx->wall_ns ? (ctx->cpu_ns * 100) / ctx->wall_ns : 0;
+
+    if (csv) {
+        printf("wait-%s-latency-avg-ns,%" PRIu64 "\n", name, avg);
+        printf("wait-%s-latency-max-ns,%" PRIu64 "\n", name,
+               ctx->latency_max_ns);
+        printf("wait-%s-cpu-pct,%" PRIu64 "\n", name, cpu_pct);
+    } else {
+        printf("%*s:  %8" PRIu64 " %8" PRIu64 " %5" PRIu64 "\n",
+               15, name, avg, ctx->latency_max_ns, cpu_pct);
+    }
+    if (ctx->n_timeouts) {
+        fprintf(stderr, "%s: %u waits reached their deadline.\n",
+                name, ctx->n_timeouts);
+    }
+}
+
+void
+bench_wait(unsigned int n_msgs, unsigned int interval_us, bool csv)
+{
+    static const enum mpsc_queue_wait_strategy strategies[] = {
+        MPSC_QUEUE_WAIT_SPIN,
+        MPSC_QUEUE_WAIT_YIELD,
+        MPSC_QUEUE_WAIT_PARK,
+    };
+    struct wait_ctx ctx;
+    pthread_t consumer;
+
+    if (!csv) {
+        printf("Benchmarking wake-up, n=%u,interval=%uus.\n",
+               n_msgs, interval_us);
+        printf("       strategy:    avg ns   max ns  cpu%%\n");
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(strategies); i++) {
+        memset(&ctx, 0, sizeof ctx);
+        mpsc_queue_init(&ctx.queue);
+        mpsc_queue_waiter_init(&ctx.waiter, strategies[i]);
+        ctx.elements = xcalloc(n_msgs, sizeof *ctx.elements);
+        ctx.n_msgs = n_msgs;
+        ctx.interval_us = interval_us;
+
+        pthread_create(&consumer, NULL, wait_consumer_main, &ctx);
+        wait_producer(&ctx);
+        pthread_join(consumer, NULL);
+
+        print_wait_result(&ctx, strategies[i], csv);
+        free(ctx.elements);
+    }
+}
+
+#ifdef __linux__
+
+struct notify_ctx {
+    struct mpsc_queue queue;
+    struct mpsc_queue_notifier notifier;
+    struct wait_element *elements;
+    unsigned int n_msgs;
+    unsigned int burst;
+    unsigned int interval_us;
+    bool coalesce;
+    /* Results. */
+    uint64_t n_writes;
+    uint64_t n_reads;
+    uint64_t n_epoll_waits;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+};
+
+static void *
+notify_consumer_main(void *aux)
+{
+    struct notify_ctx *ctx = aux;
+    struct mpsc_queue_node *node;
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+    };
+    unsigned int n = 0;
+    int epfd;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, ctx->notifier.fd, &ev)) {
+        perror("epoll");
+        abort();
+    }
+
+    while (n < ctx->n_msgs) {
+        if (epoll_wait(epfd, &ev, 1, 1000) <= 0) {
+            ctx->n_epoll_waits++;
+            continue;
+        }
+        ctx->n_epoll_waits++;
+
+        mpsc_queue_notifier_clear(&ctx->notifier);
+        ctx->n_reads++;
+
+        MPSC_QUEUE_FOR_EACH_POP (node, &ctx->queue) {
+            struct wait_element *e;
+            uint64_t latency;
+
+            e = container_of(node, struct wait_element, node);
+            latency = time_nsec() - e->sent_ns;
+            ctx->latency_sum_ns += latency;
+            ctx->latency_max_ns = MAX(ctx->latency_max_ns, latency);
+            n++;
+        }
+    }
+
+    close(epfd);
+    return NULL;
+}
+
+static void
+notify_producer(struct notify_ctx *ctx)
+{
+    struct timespec pause = {
+        .tv_sec = ctx->interval_us / (1000 * 1000),
+        .tv_nsec = (ctx->interval_us % (1000 * 1000)) * 1000,
+    };
+    unsigned int i = 0;
+
+    while (i < ctx->n_msgs) {
+        for (unsigned int j = 0; j < ctx->burst && i < ctx->n_msgs; j++) {
+            struct wait_element *e = &ctx->elements[i++];
+            bool was_empty;
+
+            e->sent_ns = time_nsec();
+            was_empty = mpsc_queue_insert(&ctx->queue, &e->node);
+            if (was_empty || !ctx->coalesce) {
+                mpsc_queue_notify(&ctx->notifier);
+                ctx->n_writes++;
+            }
+        }
+        nanosleep(&pause, NULL);
+    }
+}
+
+static void
+print_notify_result(struct notify_ctx *ctx, bool csv)
+{
+    const char *name = ctx->coalesce ? "coalesced" : "every";
+    uint64_t syscalls;
+    uint64_t avg;
+
+    /* Per thousand messages, to keep integer values readable. */
+    syscalls = ctx->n_writes + ctx->n_reads + ctx->n_epoll_waits;
+    syscalls = (syscalls * 1000) / ctx->n_msgs;
+    avg = ctx->latency_sum_ns / ctx->n_msgs;
+
+    if (csv) {
+        printf("notify-%s-syscalls-per-kmsg,%" PRIu64 "\n", name, syscalls);
+        printf("notify-%s-writes,%" PRIu64 "\n", name, ctx->n_writes);
+        printf("notify-%s-latency-avg-ns,%" PRIu64 "\n", name, avg);
+        printf("notify-%s-latency-max-ns,%" PRIu64 "\n", name,
+               ctx->latency_max_ns);
+    } else {
+        printf("%*s:  %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+               15, name, ctx->n_writes, syscalls, avg, ctx->latency_max_ns);
+    }
+}
+
+void
+bench_notify(unsigned int n_msgs, unsigned int burst,
+             unsigned int interval_us, bool csv)
+{
+    struct notify_ctx ctx;
+    pthread_t consumer;
+
+    if (!csv) {
+        printf("Benchmarking eventfd notification, "
+               "n=%u,burst=%u,interval=%uus.\n",
+               n_msgs, burst, interval_us);
+        printf("           mode:    writes sys/kmsg   avg ns   max ns\n");
+    }
+
+    for (int coalesce = 0; coalesce <= 1; coalesce++) {
+        memset(&ctx, 0, sizeof ctx);
+        mpsc_queue_init(&ctx.queue);
+        if (mpsc_queue_notifier_init(&ctx.notifier)) {
+            perror("eventfd");
+            abort();
+        }
+        ctx.elements = xcalloc(n_msgs, sizeof *ctx.elements);
+        ctx.n_msgs = n_msgs;
+        ctx.burst = MAX(burst, 1u);
+        ctx.interval_us = interval_us;
+        ctx.coalesce = coalesce;
+
+        pthread_create(&consumer, NULL, notify_consumer_main, &ctx);
+        notify_producer(&ctx);
+        pthread_join(consumer, NULL);
+
+        print_notify_result(&ctx, csv);
+        mpsc_queue_notifier_destroy(&ctx.notifier);
+        free(ctx.elements);
+    }
+}
+
+#else
+
+void
+bench_notify(unsigned int n_msgs, unsigned int burst,
+             unsigned int interval_us, bool csv)
+{
+    (void) n_msgs;
+    (void) burst;
+    (void) interval_us;
+    (void) csv;
+    fprintf(stderr, "eventfd notification is only available on Linux.\n");
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+/* Primitives. */
+#include "fc-mpsc-queue.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+/* Producers are per-thread. They are registered again when the queue
+ * is initialized again, which is noticed through a generation number. */
+static unsigned int fc_generation;
+static _Thread_local struct {
+    struct fc_mpsc_queue_producer producer;
+    unsigned int generation;
+} local;
+
+static struct fc_mpsc_queue_producer *
+local_producer(struct fc_mpsc_queue *q)
+{
+    if (local.generation != fc_generation) {
+        if (!fc_mpsc_queue_producer_init(&local.producer, q)) {
+            fprintf(stderr, "flat-combining: more than %d producers.\n",
+                    FC_MPSC_QUEUE_MAX_PRODUCERS);
+            abort();
+        }
+        local.generation = fc_generation;
+    }
+    return &local.producer;
+}
+
+static void
+fc_mpsc_queue_init_impl(struct mpscq_handle *hdl)
+{
+    fc_mpsc_queue_init(from_mpscq(hdl));
+    fc_generation++;
+}
+
+static bool
+fc_mpsc_queue_is_empty_impl(struct mpscq_handle *hdl)
+{
+    struct fc_mpsc_queue *q = from_mpscq(hdl);
+
+    return mpsc_queue_is_empty(&q->queue);
+}
+
+static void
+fc_mpsc_queue_insert_impl(struct mpscq_handle *hdl, union mpscq_node *node)
+{
+    fc_mpsc_queue_insert(local_producer(from_mpscq(hdl)), &node->dv);
+}
+
+static void
+fc_mpsc_queue_insert_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                                union mpscq_node *node_ptrs[n_nodes])
+{
+    struct mpsc_queue_node *batch[n_nodes];
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        batch[i] = &node_ptrs[i]->dv;
+    }
+    fc_mpsc_queue_insert_batch(local_producer(from_mpscq(hdl)),
+                               n_nodes, batch);
+}
+
+static union mpscq_node *
+fc_mpsc_queue_pop_impl(struct mpscq_handle *hdl)
+{
+    struct fc_mpsc_queue *q = from_mpscq(hdl);
+    struct mpsc_queue_node *node = mpsc_queue_pop(&q->queue);
+
+    if (node != NULL) {
+        return container_of(node, union mpscq_node, dv);
+    }
+    return NULL;
+}
+
+static size_t
+fc_mpsc_queue_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                             union mpscq_node *nodes[n_nodes])
+{
+    struct fc_mpsc_queue *q = from_mpscq(hdl);
+    struct mpsc_queue_node *batch[n_nodes];
+    size_t n;
+
+    n = mpsc_queue_pop_batch(&q->queue, n_nodes, batch);
+    for (size_t i = 0; i < n; i++) {
+        nodes[i] = container_of(batch[i], union mpscq_node, dv);
+    }
+    return n;
+}
+
+static struct fc_mpsc_queue static_fc_mpsc_queue;
+
+struct mpscq fc_mpsc_queue = {
+    .handle = to_mpscq(&static_fc_mpsc_queue),
+    .init = fc_mpsc_queue_init_impl,
+    .is_empty = fc_mpsc_queue_is_empty_impl,
+    .insert = fc_mpsc_queue_insert_impl,
+    .insert_batch = fc_mpsc_queue_insert_batch_impl,
+    .pop = fc_mpsc_queue_pop_impl,
+    .pop_batch = fc_mpsc_queue_pop_batch_impl,
+    .desc = "flat-combining",
+};
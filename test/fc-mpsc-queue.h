@@ -0,0 +1,201 @@
+#ifndef FC_MPSC_QUEUE_H
+#define FC_MPSC_QUEUE_H
+
+/* Flat-combining front-end to 'mpsc-queue.h'.
+ *
+ * Each producer publishes its nodes, already linked, in its own slot.
+ * The producer that takes the combiner lock collects the requests of
+ * all slots, links them into a single chain and inserts it with one
+ * exchange, then marks them done. The others wait for their request to
+ * be done, or for the lock to be free to combine themselves.
+ *
+ * Under contention, the queue head is then exchanged once per
+ * combining pass instead of once per insertion. The consumer side is
+ * the one of the underlying queue.
+ */
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "mpsc-queue.h"
+
+#define FC_MPSC_QUEUE_MAX_PRODUCERS 128
+/* Polls of a pending request before yielding the CPU. */
+#define FC_MPSC_QUEUE_SPIN 1024
+
+struct fc_mpsc_queue_slot {
+    /* Non-NULL while a request is pending. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    _Atomic(struct mpsc_queue_node *) first;
+    struct mpsc_queue_node *last;
+};
+
+struct fc_mpsc_queue {
+    struct mpsc_queue queue;
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) _Atomic(bool) combining;
+    _Atomic(size_t) n_slots;
+    /* Number of combining passes, and of requests they served. */
+    uint64_t n_passes;
+    uint64_t n_combined;
+    struct fc_mpsc_queue_slot slots[FC_MPSC_QUEUE_MAX_PRODUCERS];
+};
+
+struct fc_mpsc_queue_producer {
+    struct fc_mpsc_queue *queue;
+    struct fc_mpsc_queue_slot *slot;
+};
+
+/* Producer API. */
+
+/* Returns false if the queue already has FC_MPSC_QUEUE_MAX_PRODUCERS. */
+static inline bool
+fc_mpsc_queue_producer_init(struct fc_mpsc_queue_producer *producer,
+                            struct fc_mpsc_queue *queue);
+
+static inline void
+fc_mpsc_queue_insert(struct fc_mpsc_queue_producer *producer,
+                     struct mpsc_queue_node *node);
+
+static inline void
+fc_mpsc_queue_insert_batch(struct fc_mpsc_queue_producer *producer,
+                           size_t n_nodes,
+                           struct mpsc_queue_node *nodes[n_nodes]);
+
+/* Consumer API: use 'mpsc-queue.h' on 'queue->queue'. */
+
+static inline void fc_mpsc_queue_init(struct fc_mpsc_queue *queue);
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+static inline bool
+fc_mpsc_queue_producer_init(struct fc_mpsc_queue_producer *producer,
+                            struct fc_mpsc_queue *queue)
+{
+    size_t id = atomic_fetch_add(&queue->n_slots, 1);
+
+    if (id >= FC_MPSC_QUEUE_MAX_PRODUCERS) {
+        atomic_fetch_sub(&queue->n_slots, 1);
+        return false;
+    }
+    producer->queue = queue;
+    producer->slot = &queue->slots[id];
+    return true;
+}
+
+/* Publish the chain 'first' to 'last', without waiting for it. */
+static inline void
+fc_mpsc_queue_publish(struct fc_mpsc_queue_producer *producer,
+                      struct mpsc_queue_node *first,
+                      struct mpsc_queue_node *last)
+{
+    producer->slot->last = last;
+    atomic_store_explicit(&producer->slot->first, first,
+                          memory_order_release);
+}
+
+/* Called with the combiner lock held. */
+static inline void
+fc_mpsc_queue_combine(struct fc_mpsc_queue *queue)
+{
+    size_t n_slots = atomic_load_explicit(&queue->n_slots,
+                                          memory_order_acquire);
+    struct fc_mpsc_queue_slot *served[FC_MPSC_QUEUE_MAX_PRODUCERS];
+    struct mpsc_queue_node *first = NULL;
+    struct mpsc_queue_node *last = NULL;
+    struct mpsc_queue_node *req;
+    size_t n = 0;
+
+    for (size_t i = 0; i < n_slots; i++) {
+        struct fc_mpsc_queue_slot *slot = &queue->slots[i];
+
+        req = atomic_load_explicit(&slot->first, memory_order_acquire);
+        if (req == NULL) {
+            continue;
+        }
+        if (last == NULL) {
+            first = req;
+        } else {
+            atomic_store_explicit(&last->next, req, memory_order_relaxed);
+        }
+        last = slot->last;
+        served[n++] = slot;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    mpsc_queue_insert_list(&queue->queue, first, last);
+    queue->n_passes++;
+    queue->n_combined += n;
+    /* Producers return once their nodes are in the queue. */
+    for (size_t i = 0; i < n; i++) {
+        atomic_store_explicit(&served[i]->first, NULL, memory_order_release);
+    }
+}
+
+static inline void
+fc_mpsc_queue_wait(struct fc_mpsc_queue_producer *producer)
+{
+    struct fc_mpsc_queue *queue = producer->queue;
+    unsigned int n = 0;
+
+    while (atomic_load_explicit(&producer->slot->first,
+                                memory_order_acquire) != NULL) {
+        if (!atomic_load_explicit(&queue->combining, memory_order_relaxed)
+            && !atomic_exchange_explicit(&queue->combining, true,
+                                         memory_order_acquire)) {
+            fc_mpsc_queue_combine(queue);
+            atomic_store_explicit(&queue->combining, false,
+                                  memory_order_release);
+        } else if (++n % FC_MPSC_QUEUE_SPIN == 0) {
+            sched_yield();
+        }
+    }
+}
+
+static inline void
+fc_mpsc_queue_insert(struct fc_mpsc_queue_producer *producer,
+                     struct mpsc_queue_node *node)
+{
+    fc_mpsc_queue_publish(producer, node, node);
+    fc_mpsc_queue_wait(producer);
+}
+
+static inline void
+fc_mpsc_queue_insert_batch(struct fc_mpsc_queue_producer *producer,
+                           size_t n_nodes,
+                           struct mpsc_queue_node *nodes[n_nodes])
+{
+    if (n_nodes == 0) {
+        return;
+    }
+    for (size_t i = 0; i < n_nodes - 1; i++) {
+        atomic_store_explicit(&nodes[i]->next, nodes[i + 1],
+                              memory_order_relaxed);
+    }
+    fc_mpsc_queue_publish(producer, nodes[0], nodes[n_nodes - 1]);
+    fc_mpsc_queue_wait(producer);
+}
+
+/* Consumer API. */
+
+static inline void
+fc_mpsc_queue_init(struct fc_mpsc_queue *queue)
+{
+    mpsc_queue_init(&queue->queue);
+    atomic_store(&queue->combining, false);
+    atomic_store(&queue->n_slots, 0);
+    queue->n_passes = 0;
+    queue->n_combined = 0;
+    for (size_t i = 0; i < FC_MPSC_QUEUE_MAX_PRODUCERS; i++) {
+        atomic_store(&queue->slots[i].first, NULL);
+        queue->slots[i].last = NULL;
+    }
+}
+
+#endif /* FC_MPSC_QUEUE_H */
@@ -0,0 +1,72 @@
+#include <string.h>
+
+#include "histogram.h"
+
+void
+histogram_init(struct histogram *h)
+{
+    memset(h, 0, sizeof *h);
+}
+
+void
+histogram_merge(struct histogram *dst, const struct histogram *src)
+{
+    for (size_t i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->n += src->n;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/* Highest value recorded in bucket 'idx'. */
+static uint64_t
+histogram_bucket_max(unsigned int idx)
+{
+    unsigned int shift;
+    uint64_t sub;
+
+    if (idx < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return idx;
+    }
+    shift = idx / HISTOGRAM_SUB_BUCKETS - 1;
+    sub = idx - shift * HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t
+histogram_percentile(const struct histogram *h, double pct)
+{
+    uint64_t rank;
+    uint64_t seen;
+    uint64_t value;
+    double exact;
+
+    if (h->n == 0) {
+        return 0;
+    }
+
+    /* Nearest rank, counting from 1. */
+    exact = pct / 100.0 * h->n;
+    rank = exact;
+    if (rank < exact) {
+        rank++;
+    }
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > h->n) {
+        rank = h->n;
+    }
+
+    seen = 0;
+    for (unsigned int i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            value = histogram_bucket_max(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
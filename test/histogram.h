@@ -0,0 +1,59 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Log-linear histogram of 64-bit values, in the manner of HdrHistogram.
+ *
+ * Values are grouped by powers of two, each power being divided in
+ * 2^HISTOGRAM_SUB_BITS linear buckets. Values below 2^HISTOGRAM_SUB_BITS
+ * are exact, the others are recorded with a relative error below
+ * 2^-HISTOGRAM_SUB_BITS, about 3%.
+ */
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_N_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_N_BUCKETS];
+    uint64_t n;
+    uint64_t sum;
+    uint64_t max;
+};
+
+void histogram_init(struct histogram *h);
+
+/* Add all values recorded in 'src' to 'dst'. */
+void histogram_merge(struct histogram *dst, const struct histogram *src);
+
+/* Value under which 'pct' percent of the values fall, 'pct' between
+ * 0 and 100. The highest value of its bucket is returned, capped
+ * at the maximum recorded. Returns 0 if the histogram is empty. */
+uint64_t histogram_percentile(const struct histogram *h, double pct);
+
+static inline unsigned int
+histogram_bucket(uint64_t value)
+{
+    unsigned int shift;
+
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    /* Keep the highest bit and HISTOGRAM_SUB_BITS bits below it. */
+    shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return shift * HISTOGRAM_SUB_BUCKETS + (value >> shift);
+}
+
+static inline void
+histogram_record(struct histogram *h, uint64_t value)
+{
+    h->counts[histogram_bucket(value)]++;
+    h->n++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+#endif /* HISTOGRAM_H */
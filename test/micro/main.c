@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "mpsc-queue.h"
+
+#include "tsc.h"
+#include "util.h"
+
+/* Uncontended cost of each operation of 'mpsc-queue.h'.
+ *
+ * An operation is repeated in a loop over a small set of nodes that
+ * stays in cache, and the whole loop is timed. The loop is run several
+ * times and the minimum and median costs are reported, in ns per
+ * operation: a call for batch insertions, a node for 'for-each'.
+ * Compiler barriers keep the operations from being merged, hoisted
+ * or removed. */
+
+#define DEFAULT_N_OPS 4096
+#define DEFAULT_N_REPS 101
+#define MAX_BATCH 64
+
+/* Forbid the compiler to keep memory values in registers across it. */
+#define clobber() __asm__ volatile("" ::: "memory")
+
+/* Make the compiler assume that 'p' is used. */
+static inline void
+escape(const void *p)
+{
+    __asm__ volatile("" :: "g" (p) : "memory");
+}
+
+struct micro_ctx {
+    struct mpsc_queue queue;
+    struct mpsc_queue_node *nodes;
+    unsigned int n_ops;
+    unsigned int batch;
+};
+
+struct micro_result {
+    double min;
+    double median;
+};
+
+/* A benchmark sets the queue up, untimed, then runs the timed loop.
+ * Returns the number of operations done in the loop. */
+struct micro {
+    const char *name;
+    void (*setup)(struct micro_ctx *ctx);
+    unsigned int (*run)(struct micro_ctx *ctx);
+    unsigned int batch;
+};
+
+static bool print_csv;
+
+static void
+setup_empty(struct micro_ctx *ctx)
+{
+    mpsc_queue_init(&ctx->queue);
+}
+
+static void
+setup_full(struct micro_ctx *ctx)
+{
+    mpsc_queue_init(&ctx->queue);
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        mpsc_queue_insert(&ctx->queue, &ctx->nodes[i]);
+    }
+}
+
+static unsigned int
+run_insert(struct micro_ctx *ctx)
+{
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        mpsc_queue_insert(&ctx->queue, &ctx->nodes[i]);
+        clobber();
+    }
+    return ctx->n_ops;
+}
+
+static unsigned int
+run_insert_batch(struct micro_ctx *ctx)
+{
+    struct mpsc_queue_node *batch[MAX_BATCH];
+    unsigned int n = ctx->n_ops / ctx->batch;
+
+    for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int j = 0; j < ctx->batch; j++) {
+            batch[j] = &ctx->nodes[i * ctx->batch + j];
+        }
+        mpsc_queue_insert_batch(&ctx->queue, ctx->batch, batch);
+        clobber();
+    }
+    return n;
+}
+
+static unsigned int
+run_poll_empty(struct micro_ctx *ctx)
+{
+    struct mpsc_queue_node *node = NULL;
+
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        escape((void *) (uintptr_t) mpsc_queue_poll(&ctx->queue, &node));
+        escape(node);
+    }
+    return ctx->n_ops;
+}
+
+static unsigned int
+run_pop(struct micro_ctx *ctx)
+{
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        escape(mpsc_queue_pop(&ctx->queue));
+    }
+    return ctx->n_ops;
+}
+
+/* The queue is drained after each insertion: every pop removes the
+ * last node and links the stub back. */
+static unsigned int
+run_insert_pop_last(struct micro_ctx *ctx)
+{
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        mpsc_queue_insert(&ctx->queue, &ctx->nodes[i]);
+        clobber();
+        escape(mpsc_queue_pop(&ctx->queue));
+    }
+    return ctx->n_ops;
+}
+
+static unsigned int
+run_push_front(struct micro_ctx *ctx)
+{
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        mpsc_queue_push_front(&ctx->queue, &ctx->nodes[i]);
+        clobber();
+    }
+    return ctx->n_ops;
+}
+
+static unsigned int
+run_for_each(struct micro_ctx *ctx)
+{
+    struct mpsc_queue_node *node;
+    unsigned int n = 0;
+
+    MPSC_QUEUE_FOR_EACH (node, &ctx->queue) {
+        escape(node);
+        n++;
+    }
+    return n;
+}
+
+static unsigned int
+run_is_empty(struct micro_ctx *ctx)
+{
+    for (unsigned int i = 0; i < ctx->n_ops; i++) {
+        escape((void *) (uintptr_t) mpsc_queue_is_empty(&ctx->queue));
+    }
+    return ctx->n_ops;
+}
+
+static const struct micro micros[] = {
+    { "insert", setup_empty, run_insert, 1 },
+    { "insert-batch-1", setup_empty, run_insert_batch, 1 },
+    { "insert-batch-4", setup_empty, run_insert_batch, 4 },
+    { "insert-batch-16", setup_empty, run_insert_batch, 16 },
+    { "insert-batch-64", setup_empty, run_insert_batch, 64 },
+    { "poll-empty", setup_empty, run_poll_empty, 1 },
+    { "pop", setup_full, run_pop, 1 },
+    { "insert+pop-last", setup_empty, run_insert_pop_last, 1 },
+    { "push-front", setup_empty, run_push_front, 1 },
+    { "for-each", setup_full, run_for_each, 1 },
+    { "is-empty", setup_empty, run_is_empty, 1 },
+};
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static struct micro_result
+micro_run(const struct micro *m, struct micro_ctx *ctx, unsigned int n_reps)
+{
+    struct micro_result res;
+    double *costs;
+
+    costs = xcalloc(n_reps, sizeof *costs);
+    ctx->batch = m->batch;
+
+    for (unsigned int r = 0; r < n_reps; r++) {
+        uint64_t start, end;
+        unsigned int n;
+
+        m->setup(ctx);
+        clobber();
+        start = tsc_read();
+        n = m->run(ctx);
+        end = tsc_read();
+        costs[r] = (double) tsc_delta_ns(start, end) / MAX(n, 1u);
+    }
+
+    qsort(costs, n_reps, sizeof *costs, cmp_double);
+    res.min = costs[0];
+    res.median = costs[n_reps / 2];
+    free(costs);
+    return res;
+}
+
+static void
+print_result(const char *name, struct micro_result res)
+{
+    if (print_csv) {
+        /* Integer values: picoseconds. */
+        printf("micro-%s-min-ps,%.0f\n", name, res.min * 1000);
+        printf("micro-%s-median-ps,%.0f\n", name, res.median * 1000);
+    } else {
+        printf("%*s: %8.2f %8.2f\n", 20, name, res.min, res.median);
+    }
+}
+
+int
+main(int argc, const char *argv[])
+{
+    struct micro_result insert = { 0 };
+    unsigned int n_reps = DEFAULT_N_REPS;
+    struct micro_ctx ctx;
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.n_ops = DEFAULT_N_OPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n")) {
+            assert(str_to_uint(argv[++i], 10, &ctx.n_ops));
+        } else if (!strcmp(argv[i], "-r")) {
+            assert(str_to_uint(argv[++i], 10, &n_reps));
+        } else if (!strcmp(argv[i], "--csv")) {
+            print_csv = true;
+        } else {
+            printf("Usage: %s [-n <ops: uint>] [-r <repetitions: uint>] "
+                   "[--csv]\n", argv[0]);
+            exit(1);
+        }
+    }
+    ctx.n_ops = ROUND_UP(MAX(ctx.n_ops, 1u), MAX_BATCH);
+    n_reps = MAX(n_reps, 1u);
+    ctx.nodes = xcalloc(ctx.n_ops, sizeof *ctx.nodes);
+
+    tsc_calibrate();
+    if (!print_csv) {
+        printf("Uncontended operations, n=%u,repetitions=%u.\n",
+               ctx.n_ops, n_reps);
+        printf("%*s: %8s %8s ns/op\n", 20, "operation", "min", "median");
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(micros); i++) {
+        struct micro_result res = micro_run(&micros[i], &ctx, n_reps);
+
+        print_result(micros[i].name, res);
+        if (micros[i].run == run_insert) {
+            insert = res;
+        } else if (micros[i].run == run_insert_pop_last) {
+            /* The stub path alone. */
+            res.min -= insert.min;
+            res.median -= insert.median;
+            print_result("pop-last", res);
+        }
+    }
+
+    free(ctx.nodes);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+/* Primitives. */
+#include "mpsc-queue-batch.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+#define AUTOBATCH_MAX_LIMIT 64
+
+/* Producer handles are per-thread. They are reset when the queue is
+ * initialized again, which is noticed through a generation number. */
+static unsigned int autobatch_generation;
+static _Thread_local struct {
+    struct mpsc_queue_batch batch;
+    unsigned int generation;
+} local;
+
+static struct mpsc_queue_batch *
+local_batch(struct mpsc_queue *q)
+{
+    if (local.generation != autobatch_generation) {
+        mpsc_queue_batch_init(&local.batch, q, AUTOBATCH_MAX_LIMIT, 0);
+        local.generation = autobatch_generation;
+    }
+    return &local.batch;
+}
+
+static void
+mpsc_queue_autobatch_init_impl(struct mpscq_handle *hdl)
+{
+    mpsc_queue_init(from_mpscq(hdl));
+    autobatch_generation++;
+}
+
+static bool
+mpsc_queue_autobatch_is_empty_impl(struct mpscq_handle *hdl)
+{
+    return mpsc_queue_is_empty(from_mpscq(hdl));
+}
+
+static void
+mpsc_queue_autobatch_insert_impl(struct mpscq_handle *hdl,
+                                 union mpscq_node *node)
+{
+    mpsc_queue_batch_insert(local_batch(from_mpscq(hdl)), &node->dv);
+}
+
+static void
+mpsc_queue_autobatch_insert_batch_impl(struct mpscq_handle *hdl,
+                                       size_t n_nodes,
+                                       union mpscq_node *node_ptrs[n_nodes])
+{
+    struct mpsc_queue_batch *batch = local_batch(from_mpscq(hdl));
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        mpsc_queue_batch_insert(batch, &node_ptrs[i]->dv);
+    }
+}
+
+static void
+mpsc_queue_autobatch_flush_impl(struct mpscq_handle *hdl)
+{
+    mpsc_queue_batch_flush(local_batch(from_mpscq(hdl)));
+}
+
+static union mpscq_node *
+mpsc_queue_autobatch_pop_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_node *node = mpsc_queue_pop(from_mpscq(hdl));
+
+    if (node != NULL) {
+        return container_of(node, union mpscq_node, dv);
+    }
+    return NULL;
+}
+
+static struct mpsc_queue static_mpsc_queue_autobatch;
+
+struct mpscq mpsc_queue_autobatch = {
+    .handle = to_mpscq(&static_mpsc_queue_autobatch),
+    .init = mpsc_queue_autobatch_init_impl,
+    .is_empty = mpsc_queue_autobatch_is_empty_impl,
+    .insert = mpsc_queue_autobatch_insert_impl,
+    .insert_batch = mpsc_queue_autobatch_insert_batch_impl,
+    .flush = mpsc_queue_autobatch_flush_impl,
+    .pop = mpsc_queue_autobatch_pop_impl,
+    .desc = "mpsc-queue-autobatch",
+};
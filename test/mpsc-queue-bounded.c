@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+#include <sched.h>
+
+/* Primitives. */
+#include "mpsc-queue-bounded.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+static size_t bounded_capacity = 1 << 16;
+static size_t bounded_quota;
+
+/* Producers are per-thread. They are reset when the queue is
+ * initialized again, which is noticed through a generation number. */
+static unsigned int bounded_generation;
+static _Thread_local struct {
+    struct mpsc_queue_producer producer;
+    unsigned int generation;
+} local;
+
+void
+mpscq_bounded_configure(size_t capacity, size_t quota)
+{
+    bounded_capacity = capacity;
+    bounded_quota = quota;
+}
+
+static struct mpsc_queue_producer *
+local_producer(struct mpsc_queue_bounded *q)
+{
+    if (local.generation != bounded_generation) {
+        mpsc_queue_producer_init(&local.producer, q, bounded_quota);
+        local.generation = bounded_generation;
+    }
+    return &local.producer;
+}
+
+static void
+mpsc_queue_bounded_init_impl(struct mpscq_handle *hdl)
+{
+    mpsc_queue_bounded_init(from_mpscq(hdl), bounded_capacity);
+    bounded_generation++;
+}
+
+static bool
+mpsc_queue_bounded_is_empty_impl(struct mpscq_handle *hdl)
+{
+    return mpsc_queue_bounded_is_empty(from_mpscq(hdl));
+}
+
+static void
+mpsc_queue_bounded_insert_impl(struct mpscq_handle *hdl,
+                               union mpscq_node *node)
+{
+    struct mpsc_queue_producer *p = local_producer(from_mpscq(hdl));
+
+    /* Backpressure: wait for the consumer to make room. */
+    while (!mpsc_queue_try_insert(p, &node->bounded)) {
+        sched_yield();
+    }
+}
+
+static void
+mpsc_queue_bounded_insert_batch_impl(struct mpscq_handle *hdl,
+                                     size_t n_nodes,
+                                     union mpscq_node *node_ptrs[n_nodes])
+{
+    struct mpsc_queue_producer *p = local_producer(from_mpscq(hdl));
+    struct mpsc_queue_bounded_node *batch[n_nodes];
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        batch[i] = &node_ptrs[i]->bounded;
+    }
+    while (!mpsc_queue_try_insert_batch(p, n_nodes, batch)) {
+        sched_yield();
+    }
+}
+
+/* An idle producer must not keep credits others may wait for. */
+static void
+mpsc_queue_bounded_flush_impl(struct mpscq_handle *hdl)
+{
+    mpsc_queue_producer_flush(local_producer(from_mpscq(hdl)));
+}
+
+static union mpscq_node *
+mpsc_queue_bounded_pop_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_bounded_node *node;
+
+    node = mpsc_queue_bounded_pop(from_mpscq(hdl));
+    if (node != NULL) {
+        return container_of(node, union mpscq_node, bounded);
+    }
+    return NULL;
+}
+
+static size_t
+mpsc_queue_bounded_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                                  union mpscq_node *nodes[n_nodes])
+{
+    struct mpsc_queue_bounded *q = from_mpscq(hdl);
+    struct mpsc_queue_node *batch[n_nodes];
+    struct mpsc_queue_bounded_node *node;
+    size_t n;
+
+    n = mpsc_queue_pop_batch(&q->queue, n_nodes, batch);
+    for (size_t i = 0; i < n; i++) {
+        node = container_of(batch[i], struct mpsc_queue_bounded_node, node);
+        mpsc_queue_bounded_release(q, node);
+        nodes[i] = container_of(node, union mpscq_node, bounded);
+    }
+    if (n < n_nodes) {
+        mpsc_queue_bounded_flush(q);
+    }
+    return n;
+}
+
+static struct mpsc_queue_bounded static_mpsc_queue_bounded;
+
+struct mpscq mpsc_queue_bounded = {
+    .handle = to_mpscq(&static_mpsc_queue_bounded),
+    .init = mpsc_queue_bounded_init_impl,
+    .is_empty = mpsc_queue_bounded_is_empty_impl,
+    .insert = mpsc_queue_bounded_insert_impl,
+    .insert_batch = mpsc_queue_bounded_insert_batch_impl,
+    .flush = mpsc_queue_bounded_flush_impl,
+    .pop = mpsc_queue_bounded_pop_impl,
+    .pop_batch = mpsc_queue_bounded_pop_batch_impl,
+    .desc = "mpsc-queue-bounded",
+};
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+/* The deferred-release implementation, with statistics counters. */
+#define MPSC_QUEUE_STATS
+#define MPSCQ_MPSC_QUEUE_DEFERRED mpsc_queue_deferred_with_stats
+#define MPSCQ_MPSC_QUEUE_DEFERRED_DESC "mpsc-deferred-stats"
+
+#include "mpsc-queue-deferred.c"
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+/* Primitives. */
+#include "mpsc-queue.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+/* The held node is kept across empty polls: the consumer moves past it
+ * once a producer links a node after it, and the stub is never inserted
+ * back. It is only dropped by 'init'.
+ *
+ * The last node returned stays linked until the next pop: this
+ * implementation cannot be used with nodes freed by the consumer. */
+static struct mpsc_queue_consumer consumer;
+
+static void
+mpsc_queue_deferred_init_impl(struct mpscq_handle *hdl)
+{
+    mpsc_queue_init(from_mpscq(hdl));
+    mpsc_queue_consumer_init(&consumer, from_mpscq(hdl));
+}
+
+static bool
+mpsc_queue_deferred_is_empty_impl(struct mpscq_handle *hdl)
+{
+    (void) hdl;
+    return mpsc_queue_consumer_is_empty(&consumer);
+}
+
+static void
+mpsc_queue_deferred_insert_impl(struct mpscq_handle *hdl,
+                                union mpscq_node *node)
+{
+    mpsc_queue_insert(from_mpscq(hdl), &node->dv);
+}
+
+static void
+mpsc_queue_deferred_insert_batch_impl(struct mpscq_handle *hdl,
+                                      size_t n_nodes,
+                                      union mpscq_node *node_ptrs[n_nodes])
+{
+    struct mpsc_queue_node *batch[n_nodes];
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        batch[i] = &node_ptrs[i]->dv;
+    }
+    mpsc_queue_insert_batch(from_mpscq(hdl), n_nodes, batch);
+}
+
+static union mpscq_node *
+mpsc_queue_deferred_pop_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_node *released;
+    struct mpsc_queue_node *node;
+
+    (void) hdl;
+    node = mpsc_queue_consumer_pop(&consumer, &released);
+    if (node != NULL) {
+        return container_of(node, union mpscq_node, dv);
+    }
+    return NULL;
+}
+
+#ifdef MPSC_QUEUE_STATS
+#include "mpsc-queue-stats.h"
+
+static uint64_t
+mpsc_queue_deferred_n_stub_inserts_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_stats stats;
+
+    mpsc_queue_stats_get(from_mpscq(hdl), &stats);
+    return stats.stub_inserts;
+}
+#endif
+
+/* This file is built again by 'mpsc-queue-deferred-stats.c',
+ * with statistics counters and under another name. */
+#ifndef MPSCQ_MPSC_QUEUE_DEFERRED
+#define MPSCQ_MPSC_QUEUE_DEFERRED mpsc_queue_deferred
+#define MPSCQ_MPSC_QUEUE_DEFERRED_DESC "mpsc-queue-deferred"
+#endif
+
+static struct mpsc_queue static_mpsc_queue_deferred;
+
+struct mpscq MPSCQ_MPSC_QUEUE_DEFERRED = {
+    .handle = to_mpscq(&static_mpsc_queue_deferred),
+    .init = mpsc_queue_deferred_init_impl,
+    .is_empty = mpsc_queue_deferred_is_empty_impl,
+    .insert = mpsc_queue_deferred_insert_impl,
+    .insert_batch = mpsc_queue_deferred_insert_batch_impl,
+    .pop = mpsc_queue_deferred_pop_impl,
+#ifdef MPSC_QUEUE_STATS
+    .n_stub_inserts = mpsc_queue_deferred_n_stub_inserts_impl,
+#endif
+    .desc = MPSCQ_MPSC_QUEUE_DEFERRED_DESC,
+};
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+/* The regular implementation, with 'head' and 'tail'
+ * on separate cache lines. */
+#define MPSC_QUEUE_CACHE_ALIGNED
+#define MPSCQ_MPSC_QUEUE mpsc_queue_padded
+#define MPSCQ_MPSC_QUEUE_DESC "mpsc-queue-padded"
+
+#include <stddef.h>
+
+#include "mpsc-queue.c"
+
+_Static_assert(offsetof(struct mpsc_queue, tail) -
+               offsetof(struct mpsc_queue, head)
+               >= MPSC_QUEUE_CACHE_LINE_SIZE,
+               "Producer and consumer fields must not share a cache line.");
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+/* Primitives. */
+#include "mpsc-queue.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+/* Single producer, single consumer. The consumer never inserts the
+ * stub: the last node popped stays linked until the next pop, and is
+ * only released by 'init'. This implementation cannot be used with
+ * more than one producer, nor with nodes freed by the consumer. */
+static struct mpsc_queue_consumer consumer;
+
+static void
+mpsc_queue_sp_init_impl(struct mpscq_handle *hdl)
+{
+    mpsc_queue_init(from_mpscq(hdl));
+    mpsc_queue_consumer_init(&consumer, from_mpscq(hdl));
+}
+
+static bool
+mpsc_queue_sp_is_empty_impl(struct mpscq_handle *hdl)
+{
+    (void) hdl;
+    return mpsc_queue_consumer_is_empty(&consumer);
+}
+
+static void
+mpsc_queue_sp_insert_impl(struct mpscq_handle *hdl, union mpscq_node *node)
+{
+    mpsc_queue_insert_sp(from_mpscq(hdl), &node->dv);
+}
+
+static void
+mpsc_queue_sp_insert_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                                union mpscq_node *node_ptrs[n_nodes])
+{
+    size_t i;
+
+    if (n_nodes == 0) {
+        return;
+    }
+    for (i = 0; i < n_nodes - 1; i++) {
+        atomic_store_explicit(&node_ptrs[i]->dv.next, &node_ptrs[i + 1]->dv,
+                              memory_order_relaxed);
+    }
+    mpsc_queue_insert_list_sp(from_mpscq(hdl), &node_ptrs[0]->dv,
+                              &node_ptrs[i]->dv);
+}
+
+static union mpscq_node *
+mpsc_queue_sp_pop_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_node *released;
+    struct mpsc_queue_node *node;
+
+    (void) hdl;
+    node = mpsc_queue_consumer_pop(&consumer, &released);
+    if (node != NULL) {
+        return container_of(node, union mpscq_node, dv);
+    }
+    return NULL;
+}
+
+static struct mpsc_queue static_mpsc_queue_sp;
+
+struct mpscq mpsc_queue_sp = {
+    .handle = to_mpscq(&static_mpsc_queue_sp),
+    .init = mpsc_queue_sp_init_impl,
+    .is_empty = mpsc_queue_sp_is_empty_impl,
+    .insert = mpsc_queue_sp_insert_impl,
+    .insert_batch = mpsc_queue_sp_insert_batch_impl,
+    .pop = mpsc_queue_sp_pop_impl,
+    .desc = "mpsc-queue-sp",
+};
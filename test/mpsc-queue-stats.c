@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2023 Gaëtan Rivet
+ */
+
+/* The regular implementation, with statistics counters. */
+#define MPSC_QUEUE_STATS
+#define MPSCQ_MPSC_QUEUE mpsc_queue_with_stats
+#define MPSCQ_MPSC_QUEUE_DESC "mpsc-queue-stats"
+
+#include <stddef.h>
+
+#include "mpsc-queue.c"
+#include "mpsc-queue-stats.h"
+
+void
+mpscq_stats_dump(FILE *stream)
+{
+    const char *names[] = { MPSCQ_MPSC_QUEUE_DESC };
+    struct mpsc_queue_stats stats;
+
+    mpsc_queue_stats_get(&static_mpsc_queue, &stats);
+    mpsc_queue_stats_dump_prometheus(stream, 1, names, &stats);
+}
@@ -18,6 +18,20 @@ mpsc_queue_init_impl(struct mpscq_handle *hdl)
     mpsc_queue_init(from_mpscq(hdl));
 }
 
+#ifdef MPSC_QUEUE_STATS
+#include "mpsc-queue-stats.h"
+
+/* Counted by each queue, for instances to be counted apart. */
+static uint64_t
+mpsc_queue_n_stub_inserts_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_stats stats;
+
+    mpsc_queue_stats_get(from_mpscq(hdl), &stats);
+    return stats.stub_inserts;
+}
+#endif
+
 static bool
 mpsc_queue_is_empty_impl(struct mpscq_handle *hdl)
 {
@@ -53,14 +67,78 @@ mpsc_queue_pop_impl(struct mpscq_handle *hdl)
     return NULL;
 }
 
+static size_t
+mpsc_queue_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                          union mpscq_node *nodes[n_nodes])
+{
+    struct mpsc_queue_node *batch[n_nodes];
+    size_t n;
+
+    n = mpsc_queue_pop_batch(from_mpscq(hdl), n_nodes, batch);
+    for (size_t i = 0; i < n; i++) {
+        nodes[i] = container_of(batch[i], union mpscq_node, dv);
+    }
+    return n;
+}
+
+static struct mpscq_chain
+mpsc_queue_take_all_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_queue_chain chain = mpsc_queue_take_all(from_mpscq(hdl));
+
+    if (chain.first == NULL) {
+        return (struct mpscq_chain){ NULL, NULL };
+    }
+    return (struct mpscq_chain){
+        .first = container_of(chain.first, union mpscq_node, dv),
+        .last = container_of(chain.last, union mpscq_node, dv),
+    };
+}
+
+static union mpscq_node *
+mpsc_queue_chain_pop_impl(struct mpscq_chain *c)
+{
+    struct mpsc_queue_chain chain;
+    struct mpsc_queue_node *node;
+
+    if (c->first == NULL) {
+        return NULL;
+    }
+
+    chain.first = &c->first->dv;
+    chain.last = &c->last->dv;
+    node = mpsc_queue_chain_pop(&chain);
+    if (chain.first != NULL) {
+        c->first = container_of(chain.first, union mpscq_node, dv);
+    } else {
+        c->first = NULL;
+        c->last = NULL;
+    }
+    return container_of(node, union mpscq_node, dv);
+}
+
+/* This file is built again by 'mpsc-queue-padded.c',
+ * with the cache-aligned layout and under another name. */
+#ifndef MPSCQ_MPSC_QUEUE
+#define MPSCQ_MPSC_QUEUE mpsc_queue
+#define MPSCQ_MPSC_QUEUE_DESC "mpsc-queue"
+#endif
+
 static struct mpsc_queue static_mpsc_queue;
 
-struct mpscq mpsc_queue = {
+struct mpscq MPSCQ_MPSC_QUEUE = {
     .handle = to_mpscq(&static_mpsc_queue),
     .init = mpsc_queue_init_impl,
     .is_empty = mpsc_queue_is_empty_impl,
     .insert = mpsc_queue_insert_impl,
     .insert_batch = mpsc_queue_insert_batch_impl,
     .pop = mpsc_queue_pop_impl,
-    .desc = "mpsc-queue",
+    .pop_batch = mpsc_queue_pop_batch_impl,
+    .take_all = mpsc_queue_take_all_impl,
+    .chain_pop = mpsc_queue_chain_pop_impl,
+#ifdef MPSC_QUEUE_STATS
+    .n_stub_inserts = mpsc_queue_n_stub_inserts_impl,
+#endif
+    .size = sizeof static_mpsc_queue,
+    .desc = MPSCQ_MPSC_QUEUE_DESC,
 };
@@ -0,0 +1,107 @@
+#include <sched.h>
+#include <stddef.h>
+
+/* Primitives. */
+#include "mpsc-ring.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+static size_t ring_capacity = 1 << 16;
+
+void
+mpscq_ring_configure(size_t capacity)
+{
+    ring_capacity = capacity;
+}
+
+static void
+mpsc_ring_init_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_ring *ring = from_mpscq(hdl);
+
+    if (ring->cells != NULL) {
+        mpsc_ring_destroy(ring);
+    }
+    if (!mpsc_ring_init(ring, ring_capacity)) {
+        out_of_memory();
+    }
+}
+
+static bool
+mpsc_ring_is_empty_impl(struct mpscq_handle *hdl)
+{
+    return mpsc_ring_is_empty(from_mpscq(hdl));
+}
+
+static void
+mpsc_ring_insert_impl(struct mpscq_handle *hdl, union mpscq_node *node)
+{
+    /* Backpressure: wait for the consumer to make room. */
+    while (!mpsc_ring_try_push(from_mpscq(hdl), node)) {
+        sched_yield();
+    }
+}
+
+static void
+mpsc_ring_insert_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                            union mpscq_node *node_ptrs[n_nodes])
+{
+    void *values[n_nodes];
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        values[i] = node_ptrs[i];
+    }
+    while (!mpsc_ring_try_push_batch(from_mpscq(hdl), n_nodes, values)) {
+        sched_yield();
+    }
+}
+
+static union mpscq_node *
+mpsc_ring_pop_impl(struct mpscq_handle *hdl)
+{
+    void *value;
+
+    if (mpsc_ring_pop(from_mpscq(hdl), &value)) {
+        return value;
+    }
+    return NULL;
+}
+
+static size_t
+mpsc_ring_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                         union mpscq_node *nodes[n_nodes])
+{
+    void *values[n_nodes];
+    size_t n;
+
+    n = mpsc_ring_pop_batch(from_mpscq(hdl), n_nodes, values);
+    for (size_t i = 0; i < n; i++) {
+        nodes[i] = values[i];
+    }
+    return n;
+}
+
+/* The cells are allocated apart from the handle, which cannot be
+ * copied to make other instances. */
+static struct mpsc_ring static_mpsc_ring;
+
+struct mpscq mpsc_ring = {
+    .handle = to_mpscq(&static_mpsc_ring),
+    .init = mpsc_ring_init_impl,
+    .is_empty = mpsc_ring_is_empty_impl,
+    .insert = mpsc_ring_insert_impl,
+    .insert_batch = mpsc_ring_insert_batch_impl,
+    .pop = mpsc_ring_pop_impl,
+    .pop_batch = mpsc_ring_pop_batch_impl,
+    .desc = "mpsc-ring",
+};
+
+_Static_assert(offsetof(struct mpsc_ring, head) -
+               offsetof(struct mpsc_ring, mask)
+               >= MPSC_QUEUE_CACHE_LINE_SIZE,
+               "Read-mostly and consumer fields must not share a cache line.");
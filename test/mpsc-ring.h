@@ -0,0 +1,219 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+/* Bounded MPSC ring buffer, after Vyukov's bounded MPMC queue.
+ *
+ * Values are stored in an array of cells instead of being linked
+ * through intrusive nodes. Each cell carries a sequence number telling
+ * whether it is free for the producer claiming position 'pos'
+ * (seq == pos) or holds a value for the consumer (seq == pos + 1).
+ * Producers claim positions with a CAS on 'tail', and the consumer,
+ * alone, reads the cells in order without any atomic read-modify-write.
+ *
+ * A producer that claimed a cell but did not fill it yet blocks the
+ * consumer on this cell: the ring looks empty until it is filled.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "mpsc-queue.h"
+
+struct mpsc_ring_cell {
+    _Atomic(size_t) seq;
+    void *value;
+};
+
+struct mpsc_ring {
+    /* Read-mostly, by all threads on each operation. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) struct mpsc_ring_cell *cells;
+    size_t mask;
+    /* Producer-shared. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) _Atomic(size_t) tail;
+    /* Consumer-owned. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE) size_t head;
+};
+
+/* 'capacity' is rounded up to a power of 2. Returns false if the
+ * cells cannot be allocated. */
+static inline bool
+mpsc_ring_init(struct mpsc_ring *ring, size_t capacity);
+static inline void mpsc_ring_destroy(struct mpsc_ring *ring);
+
+static inline size_t mpsc_ring_capacity(const struct mpsc_ring *ring);
+
+/* Producer API. */
+
+/* Returns false if the ring is full. */
+static inline bool mpsc_ring_try_push(struct mpsc_ring *ring, void *value);
+
+/* Push all values at once, in consecutive cells, or none of them. */
+static inline bool
+mpsc_ring_try_push_batch(struct mpsc_ring *ring, size_t n_values,
+                         void *values[n_values]);
+
+/* Consumer API. */
+
+/* Returns false if no value is ready. */
+static inline bool mpsc_ring_pop(struct mpsc_ring *ring, void **value);
+
+/* Pop up to 'n_values' values, returns the number popped. */
+static inline size_t
+mpsc_ring_pop_batch(struct mpsc_ring *ring, size_t n_values,
+                    void *values[n_values]);
+
+static inline bool mpsc_ring_is_empty(struct mpsc_ring *ring);
+
+/* Implementation. */
+
+static inline bool
+mpsc_ring_init(struct mpsc_ring *ring, size_t capacity)
+{
+    size_t align = MPSC_QUEUE_CACHE_LINE_SIZE;
+    size_t size = 1;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+    ring->cells = aligned_alloc(align, (size * sizeof *ring->cells
+                                        + align - 1) / align * align);
+    if (ring->cells == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&ring->cells[i].seq, i);
+        ring->cells[i].value = NULL;
+    }
+    ring->mask = size - 1;
+    ring->head = 0;
+    atomic_init(&ring->tail, 0);
+    return true;
+}
+
+static inline void
+mpsc_ring_destroy(struct mpsc_ring *ring)
+{
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+static inline size_t
+mpsc_ring_capacity(const struct mpsc_ring *ring)
+{
+    return ring->mask + 1;
+}
+
+/* Claim 'n' positions starting at the returned one. Cells are freed
+ * in order by the consumer, so the last one being free is enough. */
+static inline bool
+mpsc_ring_claim(struct mpsc_ring *ring, size_t n, size_t *pos)
+{
+    struct mpsc_ring_cell *cell;
+    intptr_t diff;
+    size_t seq;
+
+    if (n == 0 || n > mpsc_ring_capacity(ring)) {
+        return false;
+    }
+
+    *pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (true) {
+        cell = &ring->cells[(*pos + n - 1) & ring->mask];
+        seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        diff = (intptr_t) seq - (intptr_t) (*pos + n - 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, pos,
+                                                      *pos + n,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                return true;
+            }
+        } else if (diff < 0) {
+            /* Not yet freed by the consumer. */
+            return false;
+        } else {
+            /* Claimed by another producer meanwhile. */
+            *pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static inline void
+mpsc_ring_fill(struct mpsc_ring *ring, size_t pos, void *value)
+{
+    struct mpsc_ring_cell *cell = &ring->cells[pos & ring->mask];
+
+    cell->value = value;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+}
+
+static inline bool
+mpsc_ring_try_push(struct mpsc_ring *ring, void *value)
+{
+    size_t pos;
+
+    if (!mpsc_ring_claim(ring, 1, &pos)) {
+        return false;
+    }
+    mpsc_ring_fill(ring, pos, value);
+    return true;
+}
+
+static inline bool
+mpsc_ring_try_push_batch(struct mpsc_ring *ring, size_t n_values,
+                         void *values[n_values])
+{
+    size_t pos;
+
+    if (!mpsc_ring_claim(ring, n_values, &pos)) {
+        return false;
+    }
+    for (size_t i = 0; i < n_values; i++) {
+        mpsc_ring_fill(ring, pos + i, values[i]);
+    }
+    return true;
+}
+
+static inline bool
+mpsc_ring_pop(struct mpsc_ring *ring, void **value)
+{
+    struct mpsc_ring_cell *cell = &ring->cells[ring->head & ring->mask];
+    size_t seq;
+
+    seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    if (seq != ring->head + 1) {
+        return false;
+    }
+    *value = cell->value;
+    /* Free the cell for the position one lap ahead. */
+    atomic_store_explicit(&cell->seq, ring->head + ring->mask + 1,
+                          memory_order_release);
+    ring->head++;
+    return true;
+}
+
+static inline size_t
+mpsc_ring_pop_batch(struct mpsc_ring *ring, size_t n_values,
+                    void *values[n_values])
+{
+    size_t n = 0;
+
+    while (n < n_values && mpsc_ring_pop(ring, &values[n])) {
+        n++;
+    }
+    return n;
+}
+
+static inline bool
+mpsc_ring_is_empty(struct mpsc_ring *ring)
+{
+    struct mpsc_ring_cell *cell = &ring->cells[ring->head & ring->mask];
+
+    return atomic_load_explicit(&cell->seq, memory_order_acquire)
+           != ring->head + 1;
+}
+
+#endif /* MPSC_RING_H */
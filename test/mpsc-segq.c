@@ -0,0 +1,118 @@
+#include <stdio.h>
+
+/* Primitives. */
+#include "mpsc-segq.h"
+
+/* Interface. */
+#include "mpscq.h"
+
+/* Implementation. */
+
+#include "util.h"
+
+/* Producers are per-thread. They are registered again when the queue
+ * is initialized again, which is noticed through a generation number. */
+static unsigned int segq_generation;
+static _Thread_local struct {
+    struct mpsc_segq_producer producer;
+    unsigned int generation;
+} local;
+
+static struct mpsc_segq_producer *
+local_producer(struct mpsc_segq *q)
+{
+    if (local.generation != segq_generation) {
+        if (!mpsc_segq_producer_init(&local.producer, q)) {
+            fprintf(stderr, "mpsc-segq: more than %d producers.\n",
+                    MPSC_SEGQ_MAX_PRODUCERS);
+            abort();
+        }
+        local.generation = segq_generation;
+    }
+    return &local.producer;
+}
+
+static void
+mpsc_segq_init_impl(struct mpscq_handle *hdl)
+{
+    struct mpsc_segq *q = from_mpscq(hdl);
+
+    if (q->head != NULL) {
+        mpsc_segq_destroy(q);
+    }
+    if (!mpsc_segq_init(q)) {
+        out_of_memory();
+    }
+    segq_generation++;
+}
+
+static bool
+mpsc_segq_is_empty_impl(struct mpscq_handle *hdl)
+{
+    return mpsc_segq_is_empty(from_mpscq(hdl));
+}
+
+static void
+mpsc_segq_insert_impl(struct mpscq_handle *hdl, union mpscq_node *node)
+{
+    if (!mpsc_segq_insert(local_producer(from_mpscq(hdl)), node)) {
+        out_of_memory();
+    }
+}
+
+static void
+mpsc_segq_insert_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                            union mpscq_node *node_ptrs[n_nodes])
+{
+    void *values[n_nodes];
+
+    for (size_t i = 0; i < n_nodes; i++) {
+        values[i] = node_ptrs[i];
+    }
+    if (!mpsc_segq_insert_batch(local_producer(from_mpscq(hdl)),
+                                n_nodes, values)) {
+        out_of_memory();
+    }
+}
+
+static void
+mpsc_segq_flush_impl(struct mpscq_handle *hdl)
+{
+    mpsc_segq_producer_release(local_producer(from_mpscq(hdl)));
+}
+
+static union mpscq_node *
+mpsc_segq_pop_impl(struct mpscq_handle *hdl)
+{
+    return mpsc_segq_pop(from_mpscq(hdl));
+}
+
+static size_t
+mpsc_segq_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                         union mpscq_node *nodes[n_nodes])
+{
+    void *values[n_nodes];
+    size_t n;
+
+    n = mpsc_segq_pop_batch(from_mpscq(hdl), n_nodes, values);
+    for (size_t i = 0; i < n; i++) {
+        nodes[i] = values[i];
+    }
+    return n;
+}
+
+/* Segments are allocated apart from the handle, which cannot be
+ * copied to make other instances. */
+static struct mpsc_segq static_mpsc_segq;
+
+struct mpscq mpsc_segq = {
+    .handle = to_mpscq(&static_mpsc_segq),
+    .init = mpsc_segq_init_impl,
+    .is_empty = mpsc_segq_is_empty_impl,
+    .insert = mpsc_segq_insert_impl,
+    .insert_batch = mpsc_segq_insert_batch_impl,
+    .flush = mpsc_segq_flush_impl,
+    .pop = mpsc_segq_pop_impl,
+    .pop_batch = mpsc_segq_pop_batch_impl,
+    .desc = "mpsc-segq",
+};
@@ -0,0 +1,433 @@
+#ifndef MPSC_SEGQ_H
+#define MPSC_SEGQ_H
+
+/* Unbounded MPSC queue of linked fixed-size segments.
+ *
+ * Producers claim a slot of the tail segment with a fetch-add on its
+ * insertion index, then store their value in it. The producer getting
+ * an index past the end of a full segment links a new one and moves
+ * the tail to it. The consumer reads the slots of its segment in
+ * order, and follows the link once the segment is done.
+ *
+ * Done segments are recycled by the consumer. Producers keep a pointer
+ * to the segment they insert into across insertions, so each of them
+ * publishes it as a hazard pointer: the consumer recycles a segment only
+ * once no producer holds it, and defers it otherwise. The hazard is set
+ * once per segment, not per insertion.
+ *
+ * As with the ring buffer, a producer that claimed a slot but did not
+ * fill it yet blocks the consumer on this slot. Values cannot be NULL.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "mpsc-queue.h"
+
+#ifndef MPSC_SEGQ_SEGMENT_SIZE
+#define MPSC_SEGQ_SEGMENT_SIZE 1024
+#endif
+
+#define MPSC_SEGQ_MAX_PRODUCERS 128
+/* Recycled segments kept for the producers. */
+#define MPSC_SEGQ_N_SPARES 4
+
+struct mpsc_segq_segment {
+    _Atomic(size_t) enq;
+    _Atomic(struct mpsc_segq_segment *) next;
+    /* Consumer-owned: deferred segments. */
+    struct mpsc_segq_segment *retired_next;
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    _Atomic(void *) slots[MPSC_SEGQ_SEGMENT_SIZE];
+};
+
+struct mpsc_segq_hazard {
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    _Atomic(struct mpsc_segq_segment *) segment;
+};
+
+struct mpsc_segq {
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    _Atomic(struct mpsc_segq_segment *) tail;
+    /* Consumer-owned. */
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    struct mpsc_segq_segment *head;
+    size_t head_idx;
+    /* Done segments still held by a producer. */
+    struct mpsc_segq_segment *retired;
+    _Alignas(MPSC_QUEUE_CACHE_LINE_SIZE)
+    _Atomic(struct mpsc_segq_segment *) spares[MPSC_SEGQ_N_SPARES];
+    _Atomic(size_t) n_producers;
+    struct mpsc_segq_hazard hazards[MPSC_SEGQ_MAX_PRODUCERS];
+};
+
+struct mpsc_segq_producer {
+    struct mpsc_segq *queue;
+    struct mpsc_segq_hazard *hazard;
+    /* Segment protected by 'hazard', if any. */
+    struct mpsc_segq_segment *segment;
+};
+
+/* Producer API. */
+
+/* Returns false if the queue already has MPSC_SEGQ_MAX_PRODUCERS. */
+static inline bool
+mpsc_segq_producer_init(struct mpsc_segq_producer *producer,
+                        struct mpsc_segq *queue);
+
+/* Drop the segment held by the producer, for an idle producer not to
+ * delay its recycling. */
+static inline void
+mpsc_segq_producer_release(struct mpsc_segq_producer *producer);
+
+/* Returns false if a new segment could not be allocated. */
+static inline bool
+mpsc_segq_insert(struct mpsc_segq_producer *producer, void *value);
+
+/* Values are claimed at once in the segment of the producer. Those past
+ * its end are inserted one at a time after it: they can be interleaved
+ * with values of other producers and spread over several segments.
+ * The values of a producer are always kept in order. */
+static inline bool
+mpsc_segq_insert_batch(struct mpsc_segq_producer *producer,
+                       size_t n_values, void *values[n_values]);
+
+/* Consumer API. */
+
+/* Returns false if the first segment cannot be allocated. */
+static inline bool mpsc_segq_init(struct mpsc_segq *queue);
+/* No producer may use the queue anymore. */
+static inline void mpsc_segq_destroy(struct mpsc_segq *queue);
+
+/* Returns NULL if no value is ready. */
+static inline void *mpsc_segq_pop(struct mpsc_segq *queue);
+
+static inline size_t
+mpsc_segq_pop_batch(struct mpsc_segq *queue, size_t n_values,
+                    void *values[n_values]);
+
+static inline bool mpsc_segq_is_empty(struct mpsc_segq *queue);
+
+/*******************/
+/* Implementation. */
+/*******************/
+
+static inline struct mpsc_segq_segment *
+mpsc_segq_segment_get(struct mpsc_segq *queue)
+{
+    struct mpsc_segq_segment *segment;
+
+    for (size_t i = 0; i < MPSC_SEGQ_N_SPARES; i++) {
+        segment = atomic_exchange(&queue->spares[i], NULL);
+        if (segment != NULL) {
+            return segment;
+        }
+    }
+    segment = aligned_alloc(MPSC_QUEUE_CACHE_LINE_SIZE, sizeof *segment);
+    if (segment != NULL) {
+        memset(segment, 0, sizeof *segment);
+    }
+    return segment;
+}
+
+/* 'segment' must be reset and unreachable by any producer. */
+static inline void
+mpsc_segq_segment_put(struct mpsc_segq *queue,
+                      struct mpsc_segq_segment *segment)
+{
+    struct mpsc_segq_segment *expected;
+
+    for (size_t i = 0; i < MPSC_SEGQ_N_SPARES; i++) {
+        expected = NULL;
+        if (atomic_compare_exchange_strong(&queue->spares[i], &expected,
+                                           segment)) {
+            return;
+        }
+    }
+    free(segment);
+}
+
+static inline void
+mpsc_segq_segment_reset(struct mpsc_segq_segment *segment)
+{
+    atomic_store_explicit(&segment->enq, 0, memory_order_relaxed);
+    atomic_store_explicit(&segment->next, NULL, memory_order_relaxed);
+    segment->retired_next = NULL;
+    memset(segment->slots, 0, sizeof segment->slots);
+}
+
+/* Producer API. */
+
+static inline bool
+mpsc_segq_producer_init(struct mpsc_segq_producer *producer,
+                        struct mpsc_segq *queue)
+{
+    size_t id = atomic_fetch_add(&queue->n_producers, 1);
+
+    if (id >= MPSC_SEGQ_MAX_PRODUCERS) {
+        atomic_fetch_sub(&queue->n_producers, 1);
+        return false;
+    }
+    producer->queue = queue;
+    producer->hazard = &queue->hazards[id];
+    producer->segment = NULL;
+    return true;
+}
+
+static inline void
+mpsc_segq_producer_release(struct mpsc_segq_producer *producer)
+{
+    atomic_store(&producer->hazard->segment, NULL);
+    producer->segment = NULL;
+}
+
+/* Protect the tail segment. The tail is read again once the hazard is
+ * set: if it did not move, the consumer will see the hazard before
+ * recycling the segment. */
+static inline struct mpsc_segq_segment *
+mpsc_segq_acquire_tail(struct mpsc_segq_producer *producer)
+{
+    struct mpsc_segq *queue = producer->queue;
+    struct mpsc_segq_segment *tail;
+    struct mpsc_segq_segment *check;
+
+    tail = atomic_load(&queue->tail);
+    while (true) {
+        atomic_store(&producer->hazard->segment, tail);
+        check = atomic_load(&queue->tail);
+        if (check == tail) {
+            break;
+        }
+        tail = check;
+    }
+    producer->segment = tail;
+    return tail;
+}
+
+/* 'full' is the protected segment found full. Link a new segment
+ * holding 'value' after it, unless another producer did. Returns
+ * false if no segment could be allocated. */
+static inline bool
+mpsc_segq_extend(struct mpsc_segq_producer *producer,
+                 struct mpsc_segq_segment *full, void *value,
+                 bool *inserted)
+{
+    struct mpsc_segq *queue = producer->queue;
+    struct mpsc_segq_segment *segment;
+    struct mpsc_segq_segment *next;
+
+    *inserted = false;
+    next = atomic_load_explicit(&full->next, memory_order_acquire);
+    if (next == NULL) {
+        segment = mpsc_segq_segment_get(queue);
+        if (segment == NULL) {
+            return false;
+        }
+        atomic_store_explicit(&segment->enq, 1, memory_order_relaxed);
+        atomic_store_explicit(&segment->slots[0], value,
+                              memory_order_relaxed);
+        if (atomic_compare_exchange_strong(&full->next, &next, segment)) {
+            *inserted = true;
+            next = segment;
+        } else {
+            mpsc_segq_segment_reset(segment);
+            mpsc_segq_segment_put(queue, segment);
+        }
+    }
+    segment = full;
+    atomic_compare_exchange_strong(&queue->tail, &segment, next);
+    return true;
+}
+
+static inline bool
+mpsc_segq_insert(struct mpsc_segq_producer *producer, void *value)
+{
+    struct mpsc_segq_segment *segment = producer->segment;
+    bool inserted;
+    size_t idx;
+
+    if (segment == NULL) {
+        segment = mpsc_segq_acquire_tail(producer);
+    }
+    while (true) {
+        idx = atomic_fetch_add_explicit(&segment->enq, 1,
+                                        memory_order_relaxed);
+        if (idx < MPSC_SEGQ_SEGMENT_SIZE) {
+            atomic_store_explicit(&segment->slots[idx], value,
+                                  memory_order_release);
+            return true;
+        }
+        if (!mpsc_segq_extend(producer, segment, value, &inserted)) {
+            return false;
+        }
+        segment = mpsc_segq_acquire_tail(producer);
+        if (inserted) {
+            return true;
+        }
+    }
+}
+
+static inline bool
+mpsc_segq_insert_batch(struct mpsc_segq_producer *producer,
+                       size_t n_values, void *values[n_values])
+{
+    struct mpsc_segq_segment *segment = producer->segment;
+    size_t idx;
+    size_t i;
+
+    if (n_values == 0) {
+        return true;
+    }
+    if (segment == NULL) {
+        segment = mpsc_segq_acquire_tail(producer);
+    }
+    idx = atomic_fetch_add_explicit(&segment->enq, n_values,
+                                    memory_order_relaxed);
+    for (i = 0; i < n_values && idx + i < MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        atomic_store_explicit(&segment->slots[idx + i], values[i],
+                              memory_order_release);
+    }
+    /* The rest goes after the end of the segment, one value at a time. */
+    for (; i < n_values; i++) {
+        if (!mpsc_segq_insert(producer, values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Consumer API. */
+
+static inline bool
+mpsc_segq_init(struct mpsc_segq *queue)
+{
+    struct mpsc_segq_segment *segment;
+
+    memset(queue, 0, sizeof *queue);
+    segment = mpsc_segq_segment_get(queue);
+    if (segment == NULL) {
+        return false;
+    }
+    atomic_store(&queue->tail, segment);
+    queue->head = segment;
+    queue->head_idx = 0;
+    return true;
+}
+
+static inline void
+mpsc_segq_destroy(struct mpsc_segq *queue)
+{
+    struct mpsc_segq_segment *segment;
+    struct mpsc_segq_segment *next;
+
+    for (segment = queue->head; segment != NULL; segment = next) {
+        next = atomic_load(&segment->next);
+        free(segment);
+    }
+    for (segment = queue->retired; segment != NULL; segment = next) {
+        next = segment->retired_next;
+        free(segment);
+    }
+    for (size_t i = 0; i < MPSC_SEGQ_N_SPARES; i++) {
+        free(atomic_load(&queue->spares[i]));
+    }
+    memset(queue, 0, sizeof *queue);
+}
+
+static inline bool
+mpsc_segq_is_hazard(struct mpsc_segq *queue,
+                    struct mpsc_segq_segment *segment)
+{
+    size_t n = atomic_load(&queue->n_producers);
+
+    for (size_t i = 0; i < n; i++) {
+        if (atomic_load(&queue->hazards[i].segment) == segment) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 'done' is no longer reachable by the consumer. Move the tail past it,
+ * then recycle it and the deferred segments no producer holds. */
+static inline void
+mpsc_segq_retire(struct mpsc_segq *queue, struct mpsc_segq_segment *done,
+                 struct mpsc_segq_segment *next)
+{
+    struct mpsc_segq_segment **prev = &queue->retired;
+    struct mpsc_segq_segment *segment = done;
+
+    atomic_compare_exchange_strong(&queue->tail, &segment, next);
+    done->retired_next = queue->retired;
+    queue->retired = done;
+
+    while ((segment = *prev) != NULL) {
+        if (mpsc_segq_is_hazard(queue, segment)) {
+            prev = &segment->retired_next;
+        } else {
+            *prev = segment->retired_next;
+            mpsc_segq_segment_reset(segment);
+            mpsc_segq_segment_put(queue, segment);
+        }
+    }
+}
+
+static inline void *
+mpsc_segq_pop(struct mpsc_segq *queue)
+{
+    struct mpsc_segq_segment *segment = queue->head;
+    struct mpsc_segq_segment *next;
+    void *value;
+
+    if (queue->head_idx == MPSC_SEGQ_SEGMENT_SIZE) {
+        next = atomic_load_explicit(&segment->next, memory_order_acquire);
+        if (next == NULL) {
+            return NULL;
+        }
+        queue->head = next;
+        queue->head_idx = 0;
+        mpsc_segq_retire(queue, segment, next);
+        segment = next;
+    }
+
+    value = atomic_load_explicit(&segment->slots[queue->head_idx],
+                                 memory_order_acquire);
+    if (value != NULL) {
+        queue->head_idx++;
+    }
+    return value;
+}
+
+static inline size_t
+mpsc_segq_pop_batch(struct mpsc_segq *queue, size_t n_values,
+                    void *values[n_values])
+{
+    size_t n = 0;
+
+    while (n < n_values && (values[n] = mpsc_segq_pop(queue)) != NULL) {
+        n++;
+    }
+    return n;
+}
+
+static inline bool
+mpsc_segq_is_empty(struct mpsc_segq *queue)
+{
+    struct mpsc_segq_segment *segment = queue->head;
+
+    if (queue->head_idx == MPSC_SEGQ_SEGMENT_SIZE) {
+        segment = atomic_load_explicit(&segment->next, memory_order_acquire);
+        if (segment == NULL) {
+            return true;
+        }
+        return atomic_load_explicit(&segment->slots[0],
+                                    memory_order_acquire) == NULL;
+    }
+    return atomic_load_explicit(&segment->slots[queue->head_idx],
+                                memory_order_acquire) == NULL;
+}
+
+#endif /* MPSC_SEGQ_H */
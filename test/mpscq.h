@@ -6,19 +6,31 @@
 #define MPSCQ_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "tailq.h"
 #include "mpsc-queue.h"
+#include "mpsc-queue-bounded.h"
 #include "ts-mpsc-queue.h"
 
 union mpscq_node {
     struct tailq_node tailq;
     struct ts_mpsc_queue_node ts;
     struct mpsc_queue_node dv;
+    struct mpsc_queue_bounded_node bounded;
 };
 
 struct mpscq_handle;
 
+/* Nodes detached from a queue at once, owned by the consumer.
+ * Each implementation knows how to walk its own chain. */
+struct mpscq_chain {
+    union mpscq_node *first;
+    union mpscq_node *last;
+};
+
 struct mpscq {
     struct mpscq_handle *handle;
     void (*init)(struct mpscq_handle *q);
@@ -26,7 +38,19 @@ struct mpscq {
     void (*insert)(struct mpscq_handle *q, union mpscq_node *node);
     void (*insert_batch)(struct mpscq_handle *q, size_t n_nodes,
                          union mpscq_node *node_ptrs[n_nodes]);
+    /* Publish nodes buffered by the calling producer, if any. */
+    void (*flush)(struct mpscq_handle *q);
     union mpscq_node *(*pop)(struct mpscq_handle *q);
+    size_t (*pop_batch)(struct mpscq_handle *q, size_t n_nodes,
+                        union mpscq_node *nodes[n_nodes]);
+    struct mpscq_chain (*take_all)(struct mpscq_handle *q);
+    union mpscq_node *(*chain_pop)(struct mpscq_chain *chain);
+    /* Number of stub insertions by the consumer since 'init'.
+     * Only set by the builds with statistics. */
+    uint64_t (*n_stub_inserts)(struct mpscq_handle *q);
+    /* Size of the queue, if all of its state is held by its handle,
+     * so that other instances can be made. */
+    size_t size;
     const char *desc;
 };
 
@@ -64,14 +88,119 @@ mpscq_insert_batch(struct mpscq *q, size_t n_nodes,
     }
 }
 
+static inline void
+mpscq_flush(struct mpscq *q)
+{
+    if (q->flush) {
+        q->flush(q->handle);
+    }
+}
+
 static inline union mpscq_node *
 mpscq_pop(struct mpscq *q)
 {
     return q->pop(q->handle);
 }
 
+static inline size_t
+mpscq_pop_batch(struct mpscq *q, size_t n_nodes,
+                union mpscq_node *nodes[n_nodes])
+{
+    size_t n = 0;
+
+    if (q->pop_batch) {
+        return q->pop_batch(q->handle, n_nodes, nodes);
+    }
+    while (n < n_nodes && (nodes[n] = mpscq_pop(q)) != NULL) {
+        n++;
+    }
+    return n;
+}
+
+static inline bool
+mpscq_has_take_all(struct mpscq *q)
+{
+    return q->take_all != NULL && q->chain_pop != NULL;
+}
+
+static inline struct mpscq_chain
+mpscq_take_all(struct mpscq *q)
+{
+    return q->take_all(q->handle);
+}
+
+static inline union mpscq_node *
+mpscq_chain_pop(struct mpscq *q, struct mpscq_chain *chain)
+{
+    return q->chain_pop(chain);
+}
+
+static inline bool
+mpscq_has_stub_stats(struct mpscq *q)
+{
+    return q->n_stub_inserts != NULL;
+}
+
+static inline uint64_t
+mpscq_n_stub_inserts(struct mpscq *q)
+{
+    return q->n_stub_inserts(q->handle);
+}
+
+static inline bool
+mpscq_has_instances(struct mpscq *q)
+{
+    return q->size != 0;
+}
+
+/* Make 'instance' a new, initialized queue of the same type as 'q',
+ * to be freed with 'mpscq_instance_free'. Returns false if it cannot
+ * be allocated. */
+static inline bool
+mpscq_instance_new(struct mpscq *q, struct mpscq *instance)
+{
+    size_t align = MPSC_QUEUE_CACHE_LINE_SIZE;
+
+    *instance = *q;
+    instance->handle = aligned_alloc(align,
+                                     (q->size + align - 1) / align * align);
+    if (instance->handle == NULL) {
+        return false;
+    }
+    mpscq_init(instance);
+    return true;
+}
+
+static inline void
+mpscq_instance_free(struct mpscq *instance)
+{
+    free(instance->handle);
+}
+
 extern struct mpscq mpsc_queue;
+extern struct mpscq mpsc_queue_padded;
+extern struct mpscq mpsc_queue_deferred;
+extern struct mpscq mpsc_queue_sp;
+extern struct mpscq mpsc_queue_with_stats;
+extern struct mpscq mpsc_queue_deferred_with_stats;
 extern struct mpscq ts_mpsc_queue;
 extern struct mpscq tailq;
+extern struct mpscq tailq_spin;
+extern struct mpscq tailq_ticket;
+extern struct mpscq tailq_mcs;
+extern struct mpscq fc_mpsc_queue;
+extern struct mpscq mpsc_queue_bounded;
+extern struct mpscq mpsc_queue_autobatch;
+extern struct mpscq mpsc_ring;
+extern struct mpscq mpsc_segq;
+
+/* A 'quota' of 0 means no per-producer limit. */
+void mpscq_bounded_configure(size_t capacity, size_t quota);
+
+/* Number of cells of 'mpsc_ring', from its next 'init'. */
+void mpscq_ring_configure(size_t capacity);
+
+/* Write the counters of 'mpsc_queue_with_stats' in Prometheus format. */
+void mpscq_stats_dump(FILE *stream);
 
 #endif /* MPSCQ_H */
@@ -4,23 +4,28 @@
 #include "mpscq.h"
 #include "util.h"
 
-#define TAILQ_MERGE(q1, q2, field) do {                       \
-        if((q2)->tqh_first) {                                 \
-            *(q1)->tqh_last = (q2)->tqh_first;                \
-            (q2)->tqh_first->field.tqe_prev = (q1)->tqh_last; \
-            (q1)->tqh_last = (q2)->tqh_last;                  \
-            TAILQ_INIT(q2);                                   \
-        }                                                     \
-    } while(0)
-
 static void
 tailq_init_impl(struct mpscq_handle *hdl)
 {
-    struct tailq *q = from_mpscq(hdl);
+    tailq_init(from_mpscq(hdl), TAILQ_LOCK_MUTEX);
+}
 
-    TAILQ_INIT(&q->plist);
-    TAILQ_INIT(&q->clist);
-    tailq_lock_init(&q->lock);
+static void
+tailq_spin_init_impl(struct mpscq_handle *hdl)
+{
+    tailq_init(from_mpscq(hdl), TAILQ_LOCK_SPIN);
+}
+
+static void
+tailq_ticket_init_impl(struct mpscq_handle *hdl)
+{
+    tailq_init(from_mpscq(hdl), TAILQ_LOCK_TICKET);
+}
+
+static void
+tailq_mcs_init_impl(struct mpscq_handle *hdl)
+{
+    tailq_init(from_mpscq(hdl), TAILQ_LOCK_MCS);
 }
 
 static bool
@@ -43,61 +48,132 @@ tailq_is_empty_impl(struct mpscq_handle *hdl)
 static void
 tailq_insert_impl(struct mpscq_handle *hdl, union mpscq_node *node)
 {
-    struct tailq *q = from_mpscq(hdl);
-
-    tailq_lock(&q->lock);
-    TAILQ_INSERT_TAIL(&q->plist, &node->tailq, node);
-    tailq_unlock(&q->lock);
+    tailq_insert(from_mpscq(hdl), &node->tailq);
 }
 
 static void
 tailq_insert_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
                         union mpscq_node *node_ptrs[n_nodes])
 {
-    struct tailq *q = from_mpscq(hdl);
     struct tailq_list batch;
 
     TAILQ_INIT(&batch);
     for (size_t i = 0; i < n_nodes; i++) {
         TAILQ_INSERT_TAIL(&batch, &node_ptrs[i]->tailq, node);
     }
-
-    tailq_lock(&q->lock);
-    TAILQ_MERGE(&q->plist, &batch, node);
-    tailq_unlock(&q->lock);
+    tailq_insert_list(from_mpscq(hdl), &batch);
 }
 
 static inline union mpscq_node *
 tailq_pop_impl(struct mpscq_handle *hdl)
 {
-    struct tailq *q = from_mpscq(hdl);
-    struct tailq_node *node = NULL;
+    struct tailq_node *node = tailq_pop(from_mpscq(hdl));
 
-    if (TAILQ_EMPTY(&q->clist)) {
-        tailq_lock(&q->lock);
-        TAILQ_MERGE(&q->clist, &q->plist, node);
-        tailq_unlock(&q->lock);
+    if (node != NULL) {
+        return container_of(node, union mpscq_node, tailq);
     }
+    return NULL;
+}
 
-    if (!TAILQ_EMPTY(&q->clist)) {
+static size_t
+tailq_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                     union mpscq_node *nodes[n_nodes])
+{
+    struct tailq *q = from_mpscq(hdl);
+    struct tailq_node *node;
+    size_t n = 0;
+
+    tailq_refill(q);
+    while (n < n_nodes && !TAILQ_EMPTY(&q->clist)) {
         node = TAILQ_FIRST(&q->clist);
         TAILQ_REMOVE(&q->clist, node, node);
+        nodes[n++] = container_of(node, union mpscq_node, tailq);
     }
 
-    if (node != NULL) {
-        return container_of(node, union mpscq_node, tailq);
+    return n;
+}
+
+static struct mpscq_chain
+tailq_take_all_impl(struct mpscq_handle *hdl)
+{
+    struct mpscq_chain chain = { NULL, NULL };
+    struct tailq *q = from_mpscq(hdl);
+
+    tailq_lock(&q->lock);
+    TAILQ_MERGE(&q->clist, &q->plist, node);
+    tailq_unlock(&q->lock);
+
+    if (!TAILQ_EMPTY(&q->clist)) {
+        chain.first = container_of(TAILQ_FIRST(&q->clist),
+                                   union mpscq_node, tailq);
+        chain.last = container_of(TAILQ_LAST(&q->clist, tailq_list),
+                                  union mpscq_node, tailq);
+        TAILQ_INIT(&q->clist);
     }
-    return NULL;
+
+    return chain;
+}
+
+static union mpscq_node *
+tailq_chain_pop_impl(struct mpscq_chain *chain)
+{
+    union mpscq_node *node = chain->first;
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (node == chain->last) {
+        chain->first = NULL;
+        chain->last = NULL;
+    } else {
+        chain->first = container_of(TAILQ_NEXT(&node->tailq, node),
+                                    union mpscq_node, tailq);
+    }
+
+    return node;
 }
 
 static struct tailq static_tailq;
+static struct tailq static_tailq_spin;
+static struct tailq static_tailq_ticket;
+static struct tailq static_tailq_mcs;
+
+/* Only the lock differs between these variants. */
+#define TAILQ_OPS                               \
+    .is_empty = tailq_is_empty_impl,            \
+    .insert = tailq_insert_impl,                \
+    .insert_batch = tailq_insert_batch_impl,    \
+    .pop = tailq_pop_impl,                      \
+    .pop_batch = tailq_pop_batch_impl,          \
+    .take_all = tailq_take_all_impl,            \
+    .chain_pop = tailq_chain_pop_impl,          \
+    .size = sizeof(struct tailq)
 
 struct mpscq tailq = {
     .handle = to_mpscq(&static_tailq),
     .init = tailq_init_impl,
-    .is_empty = tailq_is_empty_impl,
-    .insert = tailq_insert_impl,
-    .insert_batch = tailq_insert_batch_impl,
-    .pop = tailq_pop_impl,
+    TAILQ_OPS,
     .desc = "tailq",
 };
+
+struct mpscq tailq_spin = {
+    .handle = to_mpscq(&static_tailq_spin),
+    .init = tailq_spin_init_impl,
+    TAILQ_OPS,
+    .desc = "tailq-spin",
+};
+
+struct mpscq tailq_ticket = {
+    .handle = to_mpscq(&static_tailq_ticket),
+    .init = tailq_ticket_init_impl,
+    TAILQ_OPS,
+    .desc = "tailq-ticket",
+};
+
+struct mpscq tailq_mcs = {
+    .handle = to_mpscq(&static_tailq_mcs),
+    .init = tailq_mcs_init_impl,
+    TAILQ_OPS,
+    .desc = "tailq-mcs",
+};
@@ -2,27 +2,44 @@
 #define TAILQ_H
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <sys/queue.h>
 
+/* Lock protecting the producers' list, chosen when the queue is
+ * initialized. */
+enum tailq_lock_type {
+    TAILQ_LOCK_MUTEX,
+    TAILQ_LOCK_SPIN,
+    /* FIFO: waiters spin on a shared 'owner' counter. */
+    TAILQ_LOCK_TICKET,
+    /* FIFO: each waiter spins on its own node. */
+    TAILQ_LOCK_MCS,
+};
+
+struct tailq_mcs_node {
+    _Atomic(struct tailq_mcs_node *) next;
+    _Atomic(bool) locked;
+};
+
+struct tailq_lock {
+    enum tailq_lock_type type;
+    union {
+        pthread_mutex_t mutex;
 #if __APPLE__
-/* No Spinlock on macos. */
-#define USE_FAIR_LOCK
-#endif
-#define USE_FAIR_LOCK
-
-#ifdef USE_FAIR_LOCK
-#define tailq_lock_type pthread_mutex_t
-#define tailq_lock_init(l) do { pthread_mutex_init(l, NULL); } while (0)
-#define tailq_lock_destroy(l) do { pthread_mutex_destroy(l); } while (0)
-#define tailq_lock(l) do { pthread_mutex_lock(l); } while (0)
-#define tailq_unlock(l) do { pthread_mutex_unlock(l); } while (0)
+        /* No spinlock on macos. */
+        _Atomic(bool) spin;
 #else
-#define tailq_lock_type pthread_spinlock_t
-#define tailq_lock_init(l) do { pthread_spin_init(l, PTHREAD_PROCESS_PRIVATE); } while (0)
-#define tailq_lock_destroy(l) do { pthread_spin_destroy(l); } while (0)
-#define tailq_lock(l) do { pthread_spin_lock(l); } while (0)
-#define tailq_unlock(l) do { pthread_spin_unlock(l); } while (0)
+        pthread_spinlock_t spin;
 #endif
+        struct {
+            _Atomic(unsigned int) next;
+            _Atomic(unsigned int) owner;
+        } ticket;
+        _Atomic(struct tailq_mcs_node *) mcs;
+    };
+};
 
 struct tailq_node {
     TAILQ_ENTRY(tailq_node) node;
@@ -35,7 +52,206 @@ struct tailq {
     struct tailq_list plist;
     /* Consumer list. */
     struct tailq_list clist;
-    tailq_lock_type lock;
+    struct tailq_lock lock;
 };
 
+#define TAILQ_MERGE(q1, q2, field) do {                       \
+        if((q2)->tqh_first) {                                 \
+            *(q1)->tqh_last = (q2)->tqh_first;                \
+            (q2)->tqh_first->field.tqe_prev = (q1)->tqh_last; \
+            (q1)->tqh_last = (q2)->tqh_last;                  \
+            TAILQ_INIT(q2);                                   \
+        }                                                     \
+    } while(0)
+
+/* Polls of a busy lock before yielding the CPU, so that a preempted
+ * holder or next owner can run when threads outnumber CPUs. */
+#define TAILQ_LOCK_SPIN_MAX 1024
+
+static inline void
+tailq_cpu_relax(unsigned int *n_polls)
+{
+    if (++*n_polls % TAILQ_LOCK_SPIN_MAX == 0) {
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+/* A thread holds at most one tailq lock at a time. */
+static _Thread_local struct tailq_mcs_node tailq_mcs_local;
+
+static inline void
+tailq_lock_init(struct tailq_lock *l, enum tailq_lock_type type)
+{
+    l->type = type;
+    switch (type) {
+    case TAILQ_LOCK_MUTEX:
+        pthread_mutex_init(&l->mutex, NULL);
+        break;
+    case TAILQ_LOCK_SPIN:
+#if __APPLE__
+        atomic_init(&l->spin, false);
+#else
+        pthread_spin_init(&l->spin, PTHREAD_PROCESS_PRIVATE);
+#endif
+        break;
+    case TAILQ_LOCK_TICKET:
+        atomic_init(&l->ticket.next, 0);
+        atomic_init(&l->ticket.owner, 0);
+        break;
+    case TAILQ_LOCK_MCS:
+        atomic_init(&l->mcs, NULL);
+        break;
+    }
+}
+
+static inline void
+tailq_lock(struct tailq_lock *l)
+{
+    struct tailq_mcs_node *node = &tailq_mcs_local;
+    struct tailq_mcs_node *prev;
+    unsigned int n_polls = 0;
+    unsigned int ticket;
+
+    switch (l->type) {
+    case TAILQ_LOCK_MUTEX:
+        pthread_mutex_lock(&l->mutex);
+        break;
+    case TAILQ_LOCK_SPIN:
+#if __APPLE__
+        while (atomic_exchange_explicit(&l->spin, true,
+                                        memory_order_acquire)) {
+            while (atomic_load_explicit(&l->spin, memory_order_relaxed)) {
+                tailq_cpu_relax(&n_polls);
+            }
+        }
+#else
+        pthread_spin_lock(&l->spin);
+#endif
+        break;
+    case TAILQ_LOCK_TICKET:
+        ticket = atomic_fetch_add_explicit(&l->ticket.next, 1,
+                                           memory_order_relaxed);
+        while (atomic_load_explicit(&l->ticket.owner,
+                                    memory_order_acquire) != ticket) {
+            tailq_cpu_relax(&n_polls);
+        }
+        break;
+    case TAILQ_LOCK_MCS:
+        atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+        atomic_store_explicit(&node->locked, true, memory_order_relaxed);
+        prev = atomic_exchange_explicit(&l->mcs, node, memory_order_acq_rel);
+        if (prev != NULL) {
+            atomic_store_explicit(&prev->next, node, memory_order_release);
+            while (atomic_load_explicit(&node->locked,
+                                        memory_order_acquire)) {
+                tailq_cpu_relax(&n_polls);
+            }
+        }
+        break;
+    }
+}
+
+static inline void
+tailq_unlock(struct tailq_lock *l)
+{
+    struct tailq_mcs_node *node = &tailq_mcs_local;
+    struct tailq_mcs_node *next;
+    unsigned int n_polls = 0;
+
+    switch (l->type) {
+    case TAILQ_LOCK_MUTEX:
+        pthread_mutex_unlock(&l->mutex);
+        break;
+    case TAILQ_LOCK_SPIN:
+#if __APPLE__
+        atomic_store_explicit(&l->spin, false, memory_order_release);
+#else
+        pthread_spin_unlock(&l->spin);
+#endif
+        break;
+    case TAILQ_LOCK_TICKET:
+        /* Only the owner writes it. */
+        atomic_store_explicit(&l->ticket.owner,
+                              atomic_load_explicit(&l->ticket.owner,
+                                                   memory_order_relaxed) + 1,
+                              memory_order_release);
+        break;
+    case TAILQ_LOCK_MCS:
+        next = atomic_load_explicit(&node->next, memory_order_acquire);
+        if (next == NULL) {
+            struct tailq_mcs_node *expected = node;
+
+            if (atomic_compare_exchange_strong_explicit(&l->mcs, &expected,
+                                                        NULL,
+                                                        memory_order_release,
+                                                        memory_order_relaxed)) {
+                break;
+            }
+            /* A waiter is linking itself. */
+            while ((next = atomic_load_explicit(&node->next,
+                                                memory_order_acquire))
+                   == NULL) {
+                tailq_cpu_relax(&n_polls);
+            }
+        }
+        atomic_store_explicit(&next->locked, false, memory_order_release);
+        break;
+    }
+}
+
+static inline void
+tailq_init(struct tailq *q, enum tailq_lock_type type)
+{
+    TAILQ_INIT(&q->plist);
+    TAILQ_INIT(&q->clist);
+    tailq_lock_init(&q->lock, type);
+}
+
+static inline void
+tailq_insert(struct tailq *q, struct tailq_node *node)
+{
+    tailq_lock(&q->lock);
+    TAILQ_INSERT_TAIL(&q->plist, node, node);
+    tailq_unlock(&q->lock);
+}
+
+/* Move all nodes of 'list' at the end of the queue. */
+static inline void
+tailq_insert_list(struct tailq *q, struct tailq_list *list)
+{
+    tailq_lock(&q->lock);
+    TAILQ_MERGE(&q->plist, list, node);
+    tailq_unlock(&q->lock);
+}
+
+/* Take the producer's list, if the consumer's one is empty. */
+static inline void
+tailq_refill(struct tailq *q)
+{
+    if (TAILQ_EMPTY(&q->clist)) {
+        tailq_lock(&q->lock);
+        TAILQ_MERGE(&q->clist, &q->plist, node);
+        tailq_unlock(&q->lock);
+    }
+}
+
+static inline struct tailq_node *
+tailq_pop(struct tailq *q)
+{
+    struct tailq_node *node = NULL;
+
+    tailq_refill(q);
+    if (!TAILQ_EMPTY(&q->clist)) {
+        node = TAILQ_FIRST(&q->clist);
+        TAILQ_REMOVE(&q->clist, node, node);
+    }
+    return node;
+}
+
 #endif /* TAILQ_H */
@@ -74,32 +74,13 @@ ts_mpsc_queue_flush(struct ts_mpsc_queue *queue)
     return pair.head;
 }
 
-/* Remove one node from the queue and returns it, standalone. */
-struct ts_mpsc_queue_node *
-ts_mpsc_queue_pop(struct ts_mpsc_queue *queue)
+void
+ts_mpsc_queue_refill(struct ts_mpsc_queue *queue)
 {
-    struct ts_mpsc_queue_node *node;
-
-    if (queue->list == NULL) {
-        struct node_pair pair = ts_mpsc_queue_flush__(queue);
-
-        queue->list = pair.head;
-        queue->tail = pair.tail;
-    }
-
-    if (queue->list == NULL) {
-        return NULL;
-    }
-
-    node = queue->list;
-    queue->list = node->next;
-    node->next = NULL;
-
-    if (node == queue->tail) {
-        queue->tail = NULL;
-    }
+    struct node_pair pair = ts_mpsc_queue_flush__(queue);
 
-    return node;
+    queue->list = pair.head;
+    queue->tail = pair.tail;
 }
 
 bool
@@ -117,20 +98,6 @@ ts_mpsc_queue_is_empty(struct ts_mpsc_queue *queue)
     return true;
 }
 
-/* Producer API. */
-
-void
-ts_mpsc_queue_insert(struct ts_mpsc_queue *queue, struct ts_mpsc_queue_node *node)
-{
-    struct ts_mpsc_queue_node *next;
-
-    next = atomic_load_explicit(&queue->head, memory_order_acquire);
-    do {
-        node->next = next;
-    } while (!atomic_compare_exchange_weak_explicit(&queue->head, &next, node,
-            memory_order_release, memory_order_relaxed));
-}
-
 static void
 ts_mpsc_queue_init_impl(struct mpscq_handle *hdl)
 {
@@ -160,6 +127,57 @@ ts_mpsc_queue_pop_impl(struct mpscq_handle *hdl)
     return NULL;
 }
 
+static size_t
+ts_mpsc_queue_pop_batch_impl(struct mpscq_handle *hdl, size_t n_nodes,
+                             union mpscq_node *nodes[n_nodes])
+{
+    struct ts_mpsc_queue_node *node;
+    size_t n = 0;
+
+    while (n < n_nodes) {
+        node = ts_mpsc_queue_pop(from_mpscq(hdl));
+        if (node == NULL) {
+            break;
+        }
+        nodes[n++] = container_of(node, union mpscq_node, ts);
+    }
+
+    return n;
+}
+
+static struct mpscq_chain
+ts_mpsc_queue_take_all_impl(struct mpscq_handle *hdl)
+{
+    struct node_pair pair = ts_mpsc_queue_flush__(from_mpscq(hdl));
+
+    if (pair.head == NULL) {
+        return (struct mpscq_chain){ NULL, NULL };
+    }
+    return (struct mpscq_chain){
+        .first = container_of(pair.head, union mpscq_node, ts),
+        .last = container_of(pair.tail, union mpscq_node, ts),
+    };
+}
+
+static union mpscq_node *
+ts_mpsc_queue_chain_pop_impl(struct mpscq_chain *chain)
+{
+    union mpscq_node *node = chain->first;
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (node == chain->last) {
+        chain->first = NULL;
+        chain->last = NULL;
+    } else {
+        chain->first = container_of(node->ts.next, union mpscq_node, ts);
+    }
+
+    return node;
+}
+
 static struct ts_mpsc_queue static_ts_mpsc_queue;
 
 struct mpscq ts_mpsc_queue = {
@@ -168,5 +186,9 @@ struct mpscq ts_mpsc_queue = {
     .is_empty = ts_mpsc_queue_is_empty_impl,
     .insert = ts_mpsc_queue_insert_impl,
     .pop = ts_mpsc_queue_pop_impl,
+    .pop_batch = ts_mpsc_queue_pop_batch_impl,
+    .take_all = ts_mpsc_queue_take_all_impl,
+    .chain_pop = ts_mpsc_queue_chain_pop_impl,
+    .size = sizeof static_ts_mpsc_queue,
     .desc = "treiber-stack",
 };
@@ -17,7 +17,17 @@ struct ts_mpsc_queue {
 
 /* Producer API. */
 
-void ts_mpsc_queue_insert(struct ts_mpsc_queue *queue, struct ts_mpsc_queue_node *node);
+static inline void
+ts_mpsc_queue_insert(struct ts_mpsc_queue *queue, struct ts_mpsc_queue_node *node)
+{
+    struct ts_mpsc_queue_node *next;
+
+    next = atomic_load_explicit(&queue->head, memory_order_acquire);
+    do {
+        node->next = next;
+    } while (!atomic_compare_exchange_weak_explicit(&queue->head, &next, node,
+            memory_order_release, memory_order_relaxed));
+}
 
 /* Consumer API. */
 
@@ -34,8 +44,33 @@ void ts_mpsc_queue_destroy(struct ts_mpsc_queue *queue);
 
 /* Empty the queue and return the nodes as an iterable list. */
 struct ts_mpsc_queue_node *ts_mpsc_queue_flush(struct ts_mpsc_queue *queue);
+/* Move the stack in the consumer list, once the list is empty. */
+void ts_mpsc_queue_refill(struct ts_mpsc_queue *queue);
+
 /* Remove one node from the queue and returns it, standalone. */
-struct ts_mpsc_queue_node *ts_mpsc_queue_pop(struct ts_mpsc_queue *queue);
+static inline struct ts_mpsc_queue_node *
+ts_mpsc_queue_pop(struct ts_mpsc_queue *queue)
+{
+    struct ts_mpsc_queue_node *node;
+
+    if (queue->list == NULL) {
+        ts_mpsc_queue_refill(queue);
+    }
+
+    if (queue->list == NULL) {
+        return NULL;
+    }
+
+    node = queue->list;
+    queue->list = node->next;
+    node->next = NULL;
+
+    if (node == queue->tail) {
+        queue->tail = NULL;
+    }
+
+    return node;
+}
 
 bool ts_mpsc_queue_is_empty(struct ts_mpsc_queue *queue);
 
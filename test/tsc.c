@@ -0,0 +1,45 @@
+#include "tsc.h"
+#include "util.h"
+
+#define TSC_CALIBRATION_NS (50 * 1000 * 1000)
+
+static double ns_per_tick = 1.0;
+static uint64_t read_overhead;
+
+void
+tsc_calibrate(void)
+{
+    long long int start_ns, end_ns;
+    uint64_t start, end;
+
+    start_ns = time_nsec();
+    start = tsc_read();
+    do {
+        end_ns = time_nsec();
+    } while (end_ns - start_ns < TSC_CALIBRATION_NS);
+    end = tsc_read();
+    ns_per_tick = (double) (end_ns - start_ns) / (end - start);
+
+    /* Cost of an empty measure, the lowest seen is the most accurate. */
+    read_overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        start = tsc_read();
+        end = tsc_read();
+        read_overhead = MIN(read_overhead, end - start);
+    }
+}
+
+double
+tsc_hz(void)
+{
+    return 1e9 / ns_per_tick;
+}
+
+uint64_t
+tsc_delta_ns(uint64_t start, uint64_t end)
+{
+    uint64_t ticks = end - start;
+
+    ticks = ticks > read_overhead ? ticks - read_overhead : 0;
+    return ticks * ns_per_tick;
+}
@@ -0,0 +1,48 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Time stamp counter, to time operations of a few nanoseconds.
+ *
+ * On x86, the TSC is read between fences so that the timed operation
+ * cannot be reordered around it. On aarch64, the virtual counter is
+ * used. Elsewhere, ticks are CLOCK_MONOTONIC nanoseconds.
+ *
+ * 'tsc_calibrate' must be called once before converting ticks. */
+
+/* Measure the tick frequency and the cost of reading the counter. */
+void tsc_calibrate(void);
+
+/* Tick frequency, in Hz. */
+double tsc_hz(void);
+
+/* Convert a number of ticks to nanoseconds, after removing the cost
+ * of the two reads delimiting the measure. */
+uint64_t tsc_delta_ns(uint64_t start, uint64_t end);
+
+static inline uint64_t
+tsc_read(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t;
+
+    __builtin_ia32_lfence();
+    t = __builtin_ia32_rdtsc();
+    __builtin_ia32_lfence();
+    return t;
+#elif defined(__aarch64__)
+    uint64_t t;
+
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r" (t) :: "memory");
+    return t;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+#endif
+}
+
+#endif /* TSC_H */
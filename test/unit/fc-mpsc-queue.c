@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "fc-mpsc-queue.h"
+#include "unit.h"
+#include "util.h"
+
+static void
+test_fc_mpsc_queue_combine(void)
+{
+    struct fc_mpsc_queue_producer p1, p2, p3;
+    struct mpsc_queue_node *batch[1];
+    struct mpsc_queue_node nodes[6];
+    struct fc_mpsc_queue q;
+    size_t i;
+
+    fc_mpsc_queue_init(&q);
+    assert(fc_mpsc_queue_producer_init(&p1, &q));
+    assert(fc_mpsc_queue_producer_init(&p2, &q));
+    assert(fc_mpsc_queue_producer_init(&p3, &q));
+
+    /* Pending requests are served by the next combiner, in the
+     * order of the slots. */
+    fc_mpsc_queue_publish(&p2, &nodes[1], &nodes[1]);
+    atomic_store(&nodes[2].next, &nodes[3]);
+    atomic_store(&nodes[3].next, &nodes[4]);
+    fc_mpsc_queue_publish(&p3, &nodes[2], &nodes[4]);
+    fc_mpsc_queue_insert(&p1, &nodes[0]);
+
+    assert(q.n_passes == 1);
+    assert(q.n_combined == 3);
+    assert(atomic_load(&p2.slot->first) == NULL);
+    assert(atomic_load(&p3.slot->first) == NULL);
+
+    /* Without contention, a producer combines its own request. */
+    batch[0] = &nodes[5];
+    fc_mpsc_queue_insert_batch(&p3, 1, batch);
+    assert(q.n_passes == 2);
+    assert(q.n_combined == 4);
+
+    for (i = 0; i < ARRAY_SIZE(nodes); i++) {
+        assert(mpsc_queue_pop(&q.queue) == &nodes[i]);
+    }
+    assert(mpsc_queue_pop(&q.queue) == NULL);
+    assert(mpsc_queue_is_empty(&q.queue));
+}
+
+void
+test_fc_mpsc_queue(void)
+{
+    test_fc_mpsc_queue_combine();
+}
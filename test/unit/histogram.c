@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "histogram.h"
+#include "unit.h"
+#include "util.h"
+
+static struct histogram h;
+
+static void
+test_histogram_exact(void)
+{
+    histogram_init(&h);
+    assert(histogram_percentile(&h, 50) == 0);
+
+    for (uint64_t i = 1; i <= 100; i++) {
+        histogram_record(&h, i);
+    }
+    assert(h.n == 100);
+    assert(h.sum == 5050);
+    assert(histogram_percentile(&h, 0) == 1);
+    assert(histogram_percentile(&h, 50) == 50);
+    assert(histogram_percentile(&h, 90) == 91);
+    assert(histogram_percentile(&h, 99) == 99);
+    assert(histogram_percentile(&h, 100) == 100);
+}
+
+static void
+test_histogram_precision(void)
+{
+    uint32_t seed = 1;
+
+    for (int i = 0; i < 10000; i++) {
+        uint64_t v = (uint64_t) xorshift32(&seed) << (i % 32);
+        uint64_t p;
+
+        histogram_init(&h);
+        histogram_record(&h, v);
+        histogram_record(&h, UINT64_MAX);
+        p = histogram_percentile(&h, 50);
+        assert(p >= v);
+        assert(p - v <= v / HISTOGRAM_SUB_BUCKETS);
+    }
+}
+
+static void
+test_histogram_merge(void)
+{
+    static struct histogram other;
+
+    histogram_init(&h);
+    histogram_init(&other);
+    histogram_record(&h, 10);
+    histogram_record(&other, 1000);
+    histogram_record(&other, 20);
+    histogram_merge(&h, &other);
+    assert(h.n == 3);
+    assert(h.max == 1000);
+    assert(histogram_percentile(&h, 50) == 20);
+    assert(histogram_percentile(&h, 100) == 1000);
+}
+
+void
+test_histogram(void)
+{
+    test_histogram_exact();
+    test_histogram_precision();
+    test_histogram_merge();
+}
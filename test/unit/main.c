@@ -26,6 +26,7 @@ test_mpscq_insert(struct mpscq *q)
         elements[i].id = i;
         mpscq_insert(q, &elements[i].node);
     }
+    mpscq_flush(q);
 
     assert(mpscq_is_empty(q) == false);
 
@@ -35,11 +36,95 @@ test_mpscq_insert(struct mpscq *q)
     }
 }
 
+static void
+test_mpscq_pop_batch(struct mpscq *q)
+{
+    union mpscq_node *nodes[3];
+    struct element elements[10];
+    union mpscq_node *node;
+    struct mpscq_chain chain;
+    size_t i, n, j;
+
+    mpscq_init(q);
+
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        elements[i].id = i;
+        mpscq_insert(q, &elements[i].node);
+    }
+    mpscq_flush(q);
+
+    i = 0;
+    while ((n = mpscq_pop_batch(q, ARRAY_SIZE(nodes), nodes))) {
+        for (j = 0; j < n; j++) {
+            assert(nodes[j] == &elements[i++].node);
+        }
+    }
+    assert(i == ARRAY_SIZE(elements));
+    assert(mpscq_is_empty(q));
+
+    if (!mpscq_has_take_all(q)) {
+        return;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        mpscq_insert(q, &elements[i].node);
+    }
+    mpscq_flush(q);
+    assert(mpscq_pop(q) == &elements[0].node);
+
+    chain = mpscq_take_all(q);
+    assert(mpscq_is_empty(q));
+    i = 1;
+    while ((node = mpscq_chain_pop(q, &chain))) {
+        assert(node == &elements[i++].node);
+    }
+    assert(i == ARRAY_SIZE(elements));
+}
+
 int main(void)
 {
     test_mpscq_insert(&ts_mpsc_queue);
     test_mpscq_insert(&tailq);
+    test_mpscq_insert(&tailq_spin);
+    test_mpscq_insert(&tailq_ticket);
+    test_mpscq_insert(&tailq_mcs);
+    test_mpscq_insert(&fc_mpsc_queue);
     test_mpscq_insert(&mpsc_queue);
+    test_mpscq_insert(&mpsc_queue_padded);
+    test_mpscq_insert(&mpsc_queue_deferred);
+    test_mpscq_insert(&mpsc_queue_deferred_with_stats);
+    test_mpscq_insert(&mpsc_queue_sp);
+    test_mpscq_insert(&mpsc_queue_with_stats);
+    test_mpscq_insert(&mpsc_queue_bounded);
+    test_mpscq_insert(&mpsc_queue_autobatch);
+    test_mpscq_insert(&mpsc_ring);
+    test_mpscq_insert(&mpsc_segq);
+    test_mpscq_pop_batch(&ts_mpsc_queue);
+    test_mpscq_pop_batch(&tailq);
+    test_mpscq_pop_batch(&tailq_spin);
+    test_mpscq_pop_batch(&tailq_ticket);
+    test_mpscq_pop_batch(&tailq_mcs);
+    test_mpscq_pop_batch(&fc_mpsc_queue);
+    test_mpscq_pop_batch(&mpsc_queue);
+    test_mpscq_pop_batch(&mpsc_queue_padded);
+    test_mpscq_pop_batch(&mpsc_queue_deferred);
+    test_mpscq_pop_batch(&mpsc_queue_deferred_with_stats);
+    test_mpscq_pop_batch(&mpsc_queue_sp);
+    test_mpscq_pop_batch(&mpsc_queue_with_stats);
+    test_mpscq_pop_batch(&mpsc_queue_bounded);
+    test_mpscq_pop_batch(&mpsc_queue_autobatch);
+    test_mpscq_pop_batch(&mpsc_ring);
+    test_mpscq_pop_batch(&mpsc_segq);
     test_mpsc_queue();
+    test_mpsc_queue_wait();
+    test_mpsc_queue_bounded();
+    test_mpsc_queue_pool();
+    test_mpsc_queue_batch();
+    test_mpsc_queue_stats();
+    test_mpsc_ring();
+    test_mpsc_segq();
+    test_fc_mpsc_queue();
+    test_tailq();
+    test_histogram();
     return 0;
 }
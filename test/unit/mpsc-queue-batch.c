@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "mpsc-queue-batch.h"
+#include "unit.h"
+#include "util.h"
+
+static void
+test_mpsc_queue_batch_adapt(void)
+{
+    struct mpsc_queue_node nodes[16];
+    struct mpsc_queue_batch batch;
+    struct mpsc_queue_node *node;
+    struct mpsc_queue q;
+    size_t i;
+
+    mpsc_queue_init(&q);
+    mpsc_queue_batch_init(&batch, &q, 4, 0);
+    assert(batch.limit == 1);
+
+    /* A drained queue keeps the limit at its minimum. */
+    assert(mpsc_queue_batch_insert(&batch, &nodes[0]));
+    assert(batch.limit == 1);
+    assert(mpsc_queue_pop(&q) == &nodes[0]);
+
+    /* The consumer falling behind doubles the limit, up to the max. */
+    assert(mpsc_queue_batch_insert(&batch, &nodes[0]));
+    assert(!mpsc_queue_batch_insert(&batch, &nodes[1]));
+    assert(batch.limit == 2);
+    for (i = 2; i < 4; i++) {
+        mpsc_queue_batch_insert(&batch, &nodes[i]);
+    }
+    assert(batch.limit == 4);
+    for (i = 4; i < 12; i++) {
+        mpsc_queue_batch_insert(&batch, &nodes[i]);
+    }
+    assert(batch.limit == 4);
+
+    /* Nodes are not visible until the batch is published. */
+    mpsc_queue_batch_insert(&batch, &nodes[12]);
+    assert(batch.n_nodes == 1);
+    i = 0;
+    MPSC_QUEUE_FOR_EACH_POP (node, &q) {
+        assert(node == &nodes[i++]);
+    }
+    assert(i == 12);
+
+    /* Publishing into the drained queue halves the limit. */
+    assert(mpsc_queue_batch_flush(&batch));
+    assert(batch.limit == 2);
+    assert(batch.n_nodes == 0);
+    assert(!mpsc_queue_batch_flush(&batch));
+    assert(mpsc_queue_pop(&q) == &nodes[12]);
+    assert(mpsc_queue_is_empty(&q));
+}
+
+static void
+test_mpsc_queue_batch_expired(void)
+{
+    struct mpsc_queue_node nodes[2];
+    struct mpsc_queue_batch batch;
+    struct mpsc_queue q;
+
+    mpsc_queue_init(&q);
+    /* 1s delay, the clock is moved by rewinding 'opened_ns'. */
+    mpsc_queue_batch_init(&batch, &q, 64, 1000 * 1000 * 1000);
+    batch.limit = 64;
+
+    mpsc_queue_batch_insert(&batch, &nodes[0]);
+    assert(!mpsc_queue_batch_flush_expired(&batch));
+    assert(batch.n_nodes == 1);
+    batch.opened_ns -= 2 * batch.max_delay_ns;
+    assert(mpsc_queue_batch_flush_expired(&batch));
+    assert(mpsc_queue_pop(&q) == &nodes[0]);
+
+    /* The delay is checked on insertion as well. */
+    mpsc_queue_batch_insert(&batch, &nodes[0]);
+    batch.opened_ns -= 2 * batch.max_delay_ns;
+    mpsc_queue_batch_insert(&batch, &nodes[1]);
+    assert(batch.n_nodes == 0);
+    assert(mpsc_queue_pop(&q) == &nodes[0]);
+    assert(mpsc_queue_pop(&q) == &nodes[1]);
+    assert(mpsc_queue_is_empty(&q));
+}
+
+void
+test_mpsc_queue_batch(void)
+{
+    test_mpsc_queue_batch_adapt();
+    test_mpsc_queue_batch_expired();
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "mpsc-queue-bounded.h"
+#include "unit.h"
+#include "util.h"
+
+struct element {
+    unsigned int id;
+    struct mpsc_queue_bounded_node node;
+};
+
+static void
+test_mpsc_queue_bounded_capacity(void)
+{
+    struct mpsc_queue_bounded_node *batch[4];
+    struct mpsc_queue_bounded_node *node;
+    struct mpsc_queue_producer p1, p2;
+    struct mpsc_queue_bounded q;
+    struct element elements[8];
+    size_t i;
+
+    mpsc_queue_bounded_init(&q, 4);
+    mpsc_queue_producer_init(&p1, &q, 0);
+    mpsc_queue_producer_init(&p2, &q, 0);
+
+    for (i = 0; i < 4; i++) {
+        elements[i].id = i;
+        assert(mpsc_queue_try_insert(&p1, &elements[i].node));
+    }
+    assert(!mpsc_queue_try_insert(&p1, &elements[4].node));
+    assert(!mpsc_queue_try_insert(&p2, &elements[4].node));
+
+    /* Credits are given back when the consumer finds the queue empty. */
+    i = 0;
+    while ((node = mpsc_queue_bounded_pop(&q))) {
+        assert(node == &elements[i++].node);
+    }
+    assert(i == 4);
+    assert(mpsc_queue_bounded_is_empty(&q));
+
+    /* Batches are inserted entirely or not at all. */
+    for (i = 0; i < 4; i++) {
+        batch[i] = &elements[i].node;
+    }
+    assert(mpsc_queue_try_insert(&p2, &elements[4].node));
+    assert(!mpsc_queue_try_insert_batch(&p1, 4, batch));
+    assert(mpsc_queue_try_insert_batch(&p1, 3, batch));
+    assert(!mpsc_queue_try_insert(&p1, &elements[5].node));
+
+    assert(mpsc_queue_bounded_pop(&q) == &elements[4].node);
+    for (i = 0; i < 3; i++) {
+        assert(mpsc_queue_bounded_pop(&q) == &elements[i].node);
+    }
+    assert(mpsc_queue_bounded_pop(&q) == NULL);
+
+    /* Credits cached by a producer can be returned. */
+    mpsc_queue_producer_flush(&p1);
+    mpsc_queue_producer_flush(&p2);
+    assert(atomic_load(&q.credits) == q.capacity);
+}
+
+static void
+test_mpsc_queue_bounded_quota(void)
+{
+    struct mpsc_queue_producer hot, cold;
+    struct mpsc_queue_bounded q;
+    struct element elements[8];
+    size_t i;
+
+    mpsc_queue_bounded_init(&q, 8);
+    mpsc_queue_producer_init(&hot, &q, 2);
+    mpsc_queue_producer_init(&cold, &q, 0);
+
+    assert(mpsc_queue_try_insert(&hot, &elements[0].node));
+    assert(mpsc_queue_try_insert(&hot, &elements[1].node));
+    assert(!mpsc_queue_try_insert(&hot, &elements[2].node));
+
+    /* Other producers still have room. */
+    for (i = 2; i < 8; i++) {
+        assert(mpsc_queue_try_insert(&cold, &elements[i].node));
+    }
+
+    /* Removing a node from the hot producer allows it again. */
+    assert(mpsc_queue_bounded_pop(&q) == &elements[0].node);
+    mpsc_queue_bounded_flush(&q);
+    assert(mpsc_queue_try_insert(&hot, &elements[0].node));
+    assert(!mpsc_queue_try_insert(&hot, &elements[0].node));
+}
+
+void
+test_mpsc_queue_bounded(void)
+{
+    test_mpsc_queue_bounded_capacity();
+    test_mpsc_queue_bounded_quota();
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "mpsc-queue-pool.h"
+#include "unit.h"
+#include "util.h"
+
+struct message {
+    unsigned int id;
+    struct mpsc_queue_pool_node pnode;
+};
+
+_Static_assert(offsetof(struct mpsc_queue_pool, returns)
+               % MPSC_QUEUE_CACHE_LINE_SIZE == 0 &&
+               offsetof(struct mpsc_queue_pool, pending_first)
+               % MPSC_QUEUE_CACHE_LINE_SIZE == 0,
+               "Producer, return channel and consumer fields must not "
+               "share a cache line.");
+
+static void
+test_mpsc_queue_pool_recycle(void)
+{
+#define N_MSGS 8
+    struct mpsc_queue_pool_recycler recycler;
+    struct mpsc_queue_pool_node *pnodes[N_MSGS];
+    struct mpsc_queue_pool_node *pnode;
+    struct mpsc_queue_pool_node *extra;
+    struct mpsc_queue_node *node;
+    struct mpsc_queue_pool pool;
+    struct mpsc_queue q;
+    size_t i;
+
+    mpsc_queue_init(&q);
+    mpsc_queue_pool_init(&pool, sizeof(struct message),
+                         offsetof(struct message, pnode));
+    mpsc_queue_pool_recycler_init(&recycler, 3);
+
+    /* An empty pool allocates. */
+    for (i = 0; i < N_MSGS; i++) {
+        struct message *m;
+
+        pnodes[i] = mpsc_queue_pool_get(&pool);
+        assert(pnodes[i] != NULL);
+        assert(pnodes[i]->pool == &pool);
+        m = container_of(pnodes[i], struct message, pnode);
+        m->id = i;
+        mpsc_queue_insert(&q, &pnodes[i]->node);
+    }
+    assert(pool.n_allocated == N_MSGS);
+
+    /* Nodes are sent back in batches of 3. */
+    i = 0;
+    MPSC_QUEUE_FOR_EACH_POP (node, &q) {
+        pnode = container_of(node, struct mpsc_queue_pool_node, node);
+        assert(container_of(pnode, struct message, pnode)->id == i);
+        mpsc_queue_pool_put(&recycler, pnode);
+        i++;
+        assert(pool.n_pending == i % 3);
+    }
+    assert(!mpsc_queue_is_empty(&pool.returns));
+    mpsc_queue_pool_recycler_flush(&recycler);
+    assert(pool.n_pending == 0);
+    assert(recycler.dirty == NULL);
+
+    /* Recycled nodes are used before allocating again, in order. */
+    for (i = 0; i < N_MSGS; i++) {
+        pnode = mpsc_queue_pool_get(&pool);
+        assert(pnode == pnodes[i]);
+    }
+    assert(pool.n_allocated == N_MSGS);
+    extra = mpsc_queue_pool_get(&pool);
+    assert(pool.n_allocated == N_MSGS + 1);
+
+    for (i = 0; i < N_MSGS; i++) {
+        mpsc_queue_pool_put(&recycler, pnodes[i]);
+    }
+    mpsc_queue_pool_put(&recycler, extra);
+    mpsc_queue_pool_recycler_flush(&recycler);
+    mpsc_queue_pool_destroy(&pool);
+#undef N_MSGS
+}
+
+static void
+test_mpsc_queue_pool_multiple(void)
+{
+    struct mpsc_queue_pool_recycler recycler;
+    struct mpsc_queue_pool_node *a, *b;
+    struct mpsc_queue_pool pools[2];
+
+    for (size_t i = 0; i < ARRAY_SIZE(pools); i++) {
+        mpsc_queue_pool_init(&pools[i], sizeof(struct message),
+                             offsetof(struct message, pnode));
+    }
+    mpsc_queue_pool_recycler_init(&recycler, 64);
+
+    a = mpsc_queue_pool_get(&pools[0]);
+    b = mpsc_queue_pool_get(&pools[1]);
+
+    /* Each node goes back to its own pool. */
+    mpsc_queue_pool_put(&recycler, b);
+    mpsc_queue_pool_put(&recycler, a);
+    mpsc_queue_pool_recycler_flush(&recycler);
+
+    assert(mpsc_queue_pool_get(&pools[0]) == a);
+    assert(mpsc_queue_pool_get(&pools[1]) == b);
+
+    mpsc_queue_pool_put(&recycler, a);
+    mpsc_queue_pool_put(&recycler, b);
+    mpsc_queue_pool_recycler_flush(&recycler);
+    for (size_t i = 0; i < ARRAY_SIZE(pools); i++) {
+        mpsc_queue_pool_destroy(&pools[i]);
+    }
+}
+
+void
+test_mpsc_queue_pool(void)
+{
+    test_mpsc_queue_pool_recycle();
+    test_mpsc_queue_pool_multiple();
+}
@@ -0,0 +1,144 @@
+#define MPSC_QUEUE_STATS
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "mpsc-queue-stats.h"
+#include "unit.h"
+#include "util.h"
+
+static void
+test_mpsc_queue_stats_count(void)
+{
+    struct mpsc_queue_node *batch[5];
+    struct mpsc_queue_stats stats;
+    struct mpsc_queue_node nodes[8];
+    struct mpsc_queue_node *node;
+    static struct mpsc_queue q;
+    size_t i;
+
+    mpsc_queue_init(&q);
+    mpsc_queue_stats_get(&q, &stats);
+    assert(stats.inserts == 0 && stats.polls == 0);
+
+    assert(mpsc_queue_pop(&q) == NULL);
+    mpsc_queue_insert(&q, &nodes[0]);
+    mpsc_queue_insert(&q, &nodes[1]);
+    for (i = 0; i < ARRAY_SIZE(batch); i++) {
+        batch[i] = &nodes[i + 2];
+    }
+    mpsc_queue_insert_batch(&q, ARRAY_SIZE(batch), batch);
+    batch[0] = &nodes[7];
+    mpsc_queue_insert_batch(&q, 1, batch);
+
+    i = 0;
+    MPSC_QUEUE_FOR_EACH_POP (node, &q) {
+        i++;
+    }
+    assert(i == 8);
+
+    mpsc_queue_stats_get(&q, &stats);
+    assert(stats.inserts == 4);
+    assert(stats.batches == 2);
+    assert(stats.batch_nodes == 6);
+    assert(stats.batch_sizes[0] == 1);
+    assert(stats.batch_sizes[2] == 1);
+    /* One empty poll before the insertions, one after. */
+    assert(stats.items == 8);
+    assert(stats.empty == 2);
+    assert(stats.polls == 10);
+    assert(stats.retries == 0);
+    assert(stats.stub_inserts == 1);
+
+    mpsc_queue_init(&q);
+    mpsc_queue_stats_get(&q, &stats);
+    assert(stats.inserts == 0 && stats.polls == 0 && stats.batches == 0);
+}
+
+/* A producer that exchanged 'head' but did not link its node yet:
+ * a batch pop stopping on it counts a retry, not an empty poll. */
+static void
+test_mpsc_queue_stats_pop_batch_retry(void)
+{
+    struct mpsc_queue_node *batch[4];
+    struct mpsc_queue_stats stats;
+    struct mpsc_queue_node nodes[2];
+    struct mpsc_queue_node *prev;
+    static struct mpsc_queue q;
+
+    mpsc_queue_init(&q);
+
+    /* Behind the stub, in a drained queue. */
+    atomic_store(&nodes[0].next, NULL);
+    prev = atomic_exchange(&q.head, &nodes[0]);
+    assert(prev == &q.stub);
+    assert(mpsc_queue_pop_batch(&q, ARRAY_SIZE(batch), batch) == 0);
+    mpsc_queue_stats_get(&q, &stats);
+    assert(stats.retries == 1 && stats.empty == 0);
+
+    /* Behind the last node. */
+    atomic_store(&prev->next, &nodes[0]);
+    atomic_store(&nodes[1].next, NULL);
+    prev = atomic_exchange(&q.head, &nodes[1]);
+    assert(prev == &nodes[0]);
+    assert(mpsc_queue_pop_batch(&q, ARRAY_SIZE(batch), batch) == 0);
+    mpsc_queue_stats_get(&q, &stats);
+    assert(stats.retries == 2 && stats.empty == 0);
+
+    atomic_store(&prev->next, &nodes[1]);
+    assert(mpsc_queue_pop_batch(&q, ARRAY_SIZE(batch), batch) == 2);
+    assert(batch[0] == &nodes[0] && batch[1] == &nodes[1]);
+    assert(mpsc_queue_pop_batch(&q, ARRAY_SIZE(batch), batch) == 0);
+    mpsc_queue_stats_get(&q, &stats);
+    assert(stats.retries == 2 && stats.empty == 1);
+    assert(stats.polls == 4 && stats.items == 2);
+}
+
+static void
+test_mpsc_queue_stats_prometheus(void)
+{
+    const char *names[] = { "a", "b" };
+    struct mpsc_queue_stats stats[2] = {
+        { .inserts = 3, .batches = 2, .batch_nodes = 9,
+          .batch_sizes = { [0] = 1, [3] = 1 } },
+        { .polls = 7 },
+    };
+    char buf[8192];
+    FILE *stream;
+    size_t n;
+
+    stream = tmpfile();
+    assert(stream != NULL);
+    assert(mpsc_queue_stats_dump_prometheus(stream, 2, names, stats) == 0);
+    rewind(stream);
+    n = fread(buf, 1, sizeof buf - 1, stream);
+    buf[n] = '\0';
+    fclose(stream);
+
+    assert(strstr(buf, "# TYPE mpsc_queue_inserts_total counter\n"));
+    assert(strstr(buf, "mpsc_queue_inserts_total{queue=\"a\"} 3\n"));
+    assert(strstr(buf, "mpsc_queue_polls_total{queue=\"b\"} 7\n"));
+    assert(strstr(buf, "# TYPE mpsc_queue_batch_size histogram\n"));
+    assert(strstr(buf, "mpsc_queue_batch_size_bucket"
+                       "{queue=\"a\",le=\"7\"} 1\n"));
+    assert(strstr(buf, "mpsc_queue_batch_size_bucket"
+                       "{queue=\"a\",le=\"15\"} 2\n"));
+    assert(strstr(buf, "mpsc_queue_batch_size_bucket"
+                       "{queue=\"a\",le=\"+Inf\"} 2\n"));
+    assert(strstr(buf, "mpsc_queue_batch_size_sum{queue=\"a\"} 9\n"));
+    assert(strstr(buf, "mpsc_queue_batch_size_count{queue=\"b\"} 0\n"));
+    /* Metadata is written once per metric. */
+    assert(strstr(strstr(buf, "# HELP mpsc_queue_polls_total") + 1,
+                  "# HELP mpsc_queue_polls_total") == NULL);
+}
+
+void
+test_mpsc_queue_stats(void)
+{
+    test_mpsc_queue_stats_count();
+    test_mpsc_queue_stats_pop_batch_retry();
+    test_mpsc_queue_stats_prometheus();
+}
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "mpsc-queue-wait.h"
+#include "unit.h"
+#include "util.h"
+
+struct element {
+    unsigned int id;
+    struct mpsc_queue_node node;
+};
+
+static void
+test_mpsc_queue_insert_was_empty(void)
+{
+    struct element elements[3];
+    struct mpsc_queue_node *batch[2];
+    struct mpsc_queue q;
+
+    mpsc_queue_init(&q);
+
+    /* Only the first insertion after a drain reports it. */
+    assert(mpsc_queue_insert(&q, &elements[0].node));
+    assert(!mpsc_queue_insert(&q, &elements[1].node));
+    assert(mpsc_queue_pop(&q) == &elements[0].node);
+    assert(!mpsc_queue_insert(&q, &elements[2].node));
+    assert(mpsc_queue_pop(&q) == &elements[1].node);
+    assert(mpsc_queue_pop(&q) == &elements[2].node);
+    assert(mpsc_queue_pop(&q) == NULL);
+
+    batch[0] = &elements[0].node;
+    batch[1] = &elements[1].node;
+    assert(mpsc_queue_insert_batch(&q, 2, batch));
+    assert(!mpsc_queue_insert(&q, &elements[2].node));
+    assert(mpsc_queue_take_all(&q).first == &elements[0].node);
+    assert(mpsc_queue_insert(&q, &elements[0].node));
+}
+
+static void
+deadline_in_ms(struct timespec *deadline, long ms)
+{
+    xclock_gettime(deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (ms % 1000) * 1000 * 1000;
+    if (deadline->tv_nsec >= 1000 * 1000 * 1000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000 * 1000 * 1000;
+    }
+}
+
+static void
+test_mpsc_queue_pop_wait(void)
+{
+    static const enum mpsc_queue_wait_strategy strategies[] = {
+        MPSC_QUEUE_WAIT_SPIN,
+        MPSC_QUEUE_WAIT_YIELD,
+        MPSC_QUEUE_WAIT_PARK,
+    };
+    struct mpsc_queue_waiter waiter;
+    struct timespec deadline;
+    struct element elements[2];
+    struct mpsc_queue q;
+
+    for (size_t i = 0; i < ARRAY_SIZE(strategies); i++) {
+        mpsc_queue_init(&q);
+        mpsc_queue_waiter_init(&waiter, strategies[i]);
+
+        if (mpsc_queue_insert(&q, &elements[0].node)) {
+            mpsc_queue_waiter_wake(&waiter);
+        }
+        if (mpsc_queue_insert(&q, &elements[1].node)) {
+            mpsc_queue_waiter_wake(&waiter);
+        }
+        assert(mpsc_queue_pop_wait(&q, &waiter, NULL) == &elements[0].node);
+        assert(mpsc_queue_pop_wait(&q, &waiter, NULL) == &elements[1].node);
+
+        /* Wait long enough to go through all steps of the strategy. */
+        deadline_in_ms(&deadline, 10);
+        assert(mpsc_queue_pop_wait(&q, &waiter, &deadline) == NULL);
+        assert(atomic_load(&waiter.state) == MPSC_QUEUE_WAITER_AWAKE);
+    }
+}
+
+struct wake_test {
+    struct mpsc_queue q;
+    struct mpsc_queue_waiter waiter;
+    struct element element;
+    /* Insert only once the consumer parked, or returned. */
+    bool wait_parked;
+    atomic_bool consumer_done;
+};
+
+static void *
+wake_test_producer(void *aux)
+{
+    struct wake_test *t = aux;
+
+    while (t->wait_parked
+           && atomic_load(&t->waiter.state) != MPSC_QUEUE_WAITER_PARKED
+           && !atomic_load(&t->consumer_done)) {
+        sched_yield();
+    }
+    sched_yield();
+    if (mpsc_queue_insert(&t->q, &t->element.node)) {
+        mpsc_queue_waiter_wake(&t->waiter);
+    }
+    return NULL;
+}
+
+/* The consumer waits on an empty queue until a producer wakes it. A lost
+ * wakeup makes it sleep until its deadline instead of hanging. */
+static void
+test_mpsc_queue_pop_wait_wake(void)
+{
+    static const enum mpsc_queue_wait_strategy strategies[] = {
+        MPSC_QUEUE_WAIT_SPIN,
+        MPSC_QUEUE_WAIT_YIELD,
+        MPSC_QUEUE_WAIT_PARK,
+    };
+    struct mpsc_queue_node *node;
+    struct timespec deadline;
+    struct wake_test t;
+    pthread_t thread;
+
+    for (size_t i = 0; i < ARRAY_SIZE(strategies); i++) {
+        for (int round = 0; round < 20; round++) {
+            mpsc_queue_init(&t.q);
+            mpsc_queue_waiter_init(&t.waiter, strategies[i]);
+            atomic_init(&t.consumer_done, false);
+            /* Other strategies, or parking without futex, never park. */
+            t.wait_parked = false;
+#ifdef __linux__
+            t.wait_parked = strategies[i] == MPSC_QUEUE_WAIT_PARK;
+#endif
+
+            assert(!pthread_create(&thread, NULL, wake_test_producer, &t));
+            deadline_in_ms(&deadline, 2000);
+            node = mpsc_queue_pop_wait(&t.q, &t.waiter, &deadline);
+            atomic_store(&t.consumer_done, true);
+            assert(!mpsc_queue_deadline_passed(&deadline));
+            assert(!pthread_join(thread, NULL));
+
+            assert(node == &t.element.node);
+            assert(atomic_load(&t.waiter.state) == MPSC_QUEUE_WAITER_AWAKE);
+        }
+    }
+}
+
+#ifdef __linux__
+static void
+test_mpsc_queue_notifier(void)
+{
+    struct mpsc_queue_notifier notifier;
+    struct element elements[3];
+    struct mpsc_queue_node *node;
+    struct mpsc_queue q;
+    size_t i;
+
+    mpsc_queue_init(&q);
+    assert(mpsc_queue_notifier_init(&notifier) == 0);
+    assert(mpsc_queue_notifier_clear(&notifier) == 0);
+
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        if (mpsc_queue_insert(&q, &elements[i].node)) {
+            mpsc_queue_notify(&notifier);
+        }
+    }
+    assert(mpsc_queue_notifier_clear(&notifier) == 1);
+    assert(mpsc_queue_notifier_clear(&notifier) == 0);
+
+    i = 0;
+    MPSC_QUEUE_FOR_EACH_POP (node, &q) {
+        i++;
+    }
+    assert(i == ARRAY_SIZE(elements));
+
+    /* Once drained, the next insertion signals again. */
+    if (mpsc_queue_insert(&q, &elements[0].node)) {
+        mpsc_queue_notify(&notifier);
+    }
+    assert(mpsc_queue_notifier_clear(&notifier) == 1);
+
+    mpsc_queue_notifier_destroy(&notifier);
+}
+#endif
+
+void
+test_mpsc_queue_wait(void)
+{
+    test_mpsc_queue_insert_was_empty();
+    test_mpsc_queue_pop_wait();
+    test_mpsc_queue_pop_wait_wake();
+#ifdef __linux__
+    test_mpsc_queue_notifier();
+#endif
+}
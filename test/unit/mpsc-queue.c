@@ -217,6 +217,7 @@ mpsc_queue_poll_begin(struct mpsc_queue *queue, struct mpsc_queue_node **node)
         }
 
         atomic_store_explicit(&queue->tail, next, memory_order_relaxed);
+        mpsc_queue_stub_unlink(queue);
         tail = next;
         next = atomic_load_explicit(&tail->next, memory_order_acquire);
     }
@@ -399,6 +400,245 @@ test_mpsc_queue_push_front(void)
     mq_destroy(q);
 }
 
+static void
+test_mpsc_queue_pop_batch(void)
+{
+    struct mpsc_queue *q = mq_create();
+    struct mpsc_queue_node *nodes[4];
+    struct mpsc_queue_node *prev;
+    struct element elements[10];
+    size_t i, n;
+
+    assert(mpsc_queue_pop_batch(q, ARRAY_SIZE(nodes), nodes) == 0);
+
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        elements[i].id = i;
+        mpsc_queue_insert(q, &elements[i].node);
+    }
+
+    i = 0;
+    while ((n = mpsc_queue_pop_batch(q, ARRAY_SIZE(nodes), nodes))) {
+        for (size_t j = 0; j < n; j++) {
+            assert(nodes[j] == &elements[i].node);
+            i++;
+        }
+    }
+    assert(i == ARRAY_SIZE(elements));
+    assert(mpsc_queue_is_empty(q));
+
+    /* The batch stops on a partial insertion. */
+    mpsc_queue_insert(q, &elements[0].node);
+    mpsc_queue_insert(q, &elements[1].node);
+    prev = mpsc_queue_insert_begin(q, &elements[2].node);
+    assert(mpsc_queue_pop_batch(q, ARRAY_SIZE(nodes), nodes) == 1);
+    assert(nodes[0] == &elements[0].node);
+    assert(mpsc_queue_pop_batch(q, ARRAY_SIZE(nodes), nodes) == 0);
+    mpsc_queue_insert_end(prev, &elements[2].node);
+    assert(mpsc_queue_pop_batch(q, ARRAY_SIZE(nodes), nodes) == 2);
+    assert(nodes[0] == &elements[1].node);
+    assert(nodes[1] == &elements[2].node);
+    assert(mpsc_queue_pop_batch(q, ARRAY_SIZE(nodes), nodes) == 0);
+    assert(mpsc_queue_is_empty(q));
+
+    /* Mixed with single pops. */
+    mpsc_queue_insert(q, &elements[0].node);
+    mpsc_queue_insert(q, &elements[1].node);
+    assert(mpsc_queue_pop(q) == &elements[0].node);
+    mpsc_queue_insert(q, &elements[2].node);
+    assert(mpsc_queue_pop_batch(q, 1, nodes) == 1);
+    assert(nodes[0] == &elements[1].node);
+    assert(mpsc_queue_pop(q) == &elements[2].node);
+    assert(mpsc_queue_pop(q) == NULL);
+
+    mq_destroy(q);
+}
+
+static size_t
+chain_check(struct mpsc_queue_chain *chain, struct element *elements,
+            size_t first)
+{
+    struct mpsc_queue_node *node;
+    size_t i = first;
+
+    MPSC_QUEUE_CHAIN_FOR_EACH_POP (node, chain) {
+        assert(node == &elements[i].node);
+        i++;
+    }
+    assert(chain->first == NULL);
+    return i - first;
+}
+
+static void
+test_mpsc_queue_take_all(void)
+{
+    struct mpsc_queue *q = mq_create();
+    struct mpsc_queue_chain chain;
+    struct mpsc_queue_node *prev;
+    struct element elements[10];
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        elements[i].id = i;
+    }
+
+    chain = mpsc_queue_take_all(q);
+    assert(chain.first == NULL);
+
+    /* Stub at the tail. */
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        mpsc_queue_insert(q, &elements[i].node);
+    }
+    chain = mpsc_queue_take_all(q);
+    assert(mpsc_queue_is_empty(q));
+    assert(chain_check(&chain, elements, 0) == ARRAY_SIZE(elements));
+
+    /* Stub out of the queue. */
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        mpsc_queue_insert(q, &elements[i].node);
+    }
+    assert(mpsc_queue_pop(q) == &elements[0].node);
+    chain = mpsc_queue_take_all(q);
+    assert(mpsc_queue_is_empty(q));
+    assert(chain_check(&chain, elements, 1) == ARRAY_SIZE(elements) - 1);
+
+    /* Nodes pushed in front of the stub. */
+    mpsc_queue_push_front(q, &elements[1].node);
+    mpsc_queue_push_front(q, &elements[0].node);
+    for (i = 2; i < ARRAY_SIZE(elements); i++) {
+        mpsc_queue_insert(q, &elements[i].node);
+    }
+    chain = mpsc_queue_take_all(q);
+    assert(mpsc_queue_is_empty(q));
+    assert(chain_check(&chain, elements, 0) == ARRAY_SIZE(elements));
+
+    mpsc_queue_push_front(q, &elements[0].node);
+    chain = mpsc_queue_take_all(q);
+    assert(mpsc_queue_is_empty(q));
+    assert(chain_check(&chain, elements, 0) == 1);
+
+    /* The queue remains usable after a detach. */
+    mpsc_queue_insert(q, &elements[0].node);
+    assert(mpsc_queue_pop(q) == &elements[0].node);
+    assert(mpsc_queue_pop(q) == NULL);
+
+    /* A partial insertion is detached as well,
+     * its link is waited upon when reached. */
+    mpsc_queue_insert(q, &elements[0].node);
+    mpsc_queue_insert(q, &elements[1].node);
+    assert(mpsc_queue_pop(q) == &elements[0].node);
+    prev = mpsc_queue_insert_begin(q, &elements[2].node);
+    chain = mpsc_queue_take_all(q);
+    assert(chain.first == &elements[1].node);
+    assert(chain.last == &elements[2].node);
+    mpsc_queue_insert_end(prev, &elements[2].node);
+    assert(chain_check(&chain, elements, 1) == 2);
+    assert(mpsc_queue_is_empty(q));
+
+    mq_destroy(q);
+}
+
+static void
+test_mpsc_queue_consumer(void)
+{
+    struct mpsc_queue_consumer consumer;
+    struct mpsc_queue *q = mq_create();
+    struct mpsc_queue_node *released;
+    struct mpsc_queue_node *prev;
+    struct element elements[4];
+
+    mpsc_queue_consumer_init(&consumer, q);
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == NULL);
+    assert(released == NULL);
+    assert(mpsc_queue_consumer_release(&consumer) == NULL);
+
+    /* The last node is held instead of inserting the stub. */
+    mpsc_queue_insert(q, &elements[0].node);
+    mpsc_queue_insert(q, &elements[1].node);
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == &elements[0].node);
+    assert(released == NULL);
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == &elements[1].node);
+    assert(released == NULL);
+    assert(consumer.held == &elements[1].node);
+    assert(!mpsc_queue_stub_is_linked(q));
+    assert(mpsc_queue_consumer_is_empty(&consumer));
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == NULL);
+    assert(released == NULL);
+
+    /* Moving past the held node releases it, the stub is not used. */
+    mpsc_queue_insert(q, &elements[2].node);
+    assert(!mpsc_queue_consumer_is_empty(&consumer));
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == &elements[2].node);
+    assert(released == &elements[1].node);
+    assert(!mpsc_queue_stub_is_linked(q));
+
+    /* Explicit release inserts the stub. */
+    assert(mpsc_queue_consumer_release(&consumer) == &elements[2].node);
+    assert(consumer.held == NULL);
+    assert(mpsc_queue_stub_is_linked(q));
+    assert(mpsc_queue_consumer_is_empty(&consumer));
+    assert(mpsc_queue_is_empty(q));
+
+    /* A held node already followed by another one
+     * is released without inserting the stub. */
+    mpsc_queue_insert(q, &elements[0].node);
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == &elements[0].node);
+    prev = mpsc_queue_insert_begin(q, &elements[3].node);
+    mpsc_queue_insert_end(prev, &elements[3].node);
+    assert(mpsc_queue_consumer_release(&consumer) == &elements[0].node);
+    assert(!mpsc_queue_stub_is_linked(q));
+    assert(mpsc_queue_consumer_pop(&consumer, &released) == &elements[3].node);
+    assert(released == NULL);
+    assert(mpsc_queue_consumer_release(&consumer) == &elements[3].node);
+    assert(mpsc_queue_is_empty(q));
+
+    mq_destroy(q);
+}
+
+static void
+test_mpsc_queue_insert_sp(void)
+{
+    struct mpsc_queue_consumer consumer;
+    struct mpsc_queue *q = mq_create();
+    struct mpsc_queue_node *released;
+    struct element elements[10];
+    size_t i;
+
+    mpsc_queue_consumer_init(&consumer, q);
+
+    assert(mpsc_queue_insert_sp(q, &elements[0].node));
+    assert(!mpsc_queue_insert_sp(q, &elements[1].node));
+    for (i = 2; i < ARRAY_SIZE(elements) - 1; i++) {
+        atomic_store_explicit(&elements[i].node.next, &elements[i + 1].node,
+                              memory_order_relaxed);
+    }
+    assert(!mpsc_queue_insert_list_sp(q, &elements[2].node,
+                                      &elements[i].node));
+
+    for (i = 0; i < ARRAY_SIZE(elements); i++) {
+        assert(!mpsc_queue_consumer_is_empty(&consumer));
+        assert(mpsc_queue_consumer_pop(&consumer, &released)
+               == &elements[i].node);
+    }
+    assert(mpsc_queue_consumer_is_empty(&consumer));
+    assert(!mpsc_queue_stub_is_linked(q));
+
+    /* The consumer holds the last node: the next insertion
+     * does not see the queue drained. */
+    assert(!mpsc_queue_insert_sp(q, &elements[0].node));
+    assert(mpsc_queue_consumer_pop(&consumer, &released)
+           == &elements[0].node);
+    assert(released == &elements[i - 1].node);
+
+    /* Releasing while the producer is idle links the stub back. */
+    assert(mpsc_queue_consumer_release(&consumer) == &elements[0].node);
+    assert(mpsc_queue_insert_sp(q, &elements[1].node));
+    assert(mpsc_queue_consumer_pop(&consumer, &released)
+           == &elements[1].node);
+    assert(released == NULL);
+
+    mq_destroy(q);
+}
+
 void
 test_mpsc_queue(void)
 {
@@ -407,4 +647,8 @@ test_mpsc_queue(void)
     test_mpsc_queue_insert_batch();
     test_mpsc_queue_poll();
     test_mpsc_queue_push_front();
+    test_mpsc_queue_pop_batch();
+    test_mpsc_queue_take_all();
+    test_mpsc_queue_consumer();
+    test_mpsc_queue_insert_sp();
 }
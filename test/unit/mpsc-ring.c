@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "mpsc-ring.h"
+#include "unit.h"
+#include "util.h"
+
+#define VALUE(i) ((void *) (uintptr_t) ((i) + 1))
+
+static void
+test_mpsc_ring_full(void)
+{
+    struct mpsc_ring ring;
+    void *values[4];
+    void *value;
+    size_t i;
+
+    /* Rounded up to a power of 2. */
+    assert(mpsc_ring_init(&ring, 3));
+    assert(mpsc_ring_capacity(&ring) == 4);
+    assert(mpsc_ring_is_empty(&ring));
+    assert(!mpsc_ring_pop(&ring, &value));
+
+    for (i = 0; i < 4; i++) {
+        assert(mpsc_ring_try_push(&ring, VALUE(i)));
+    }
+    assert(!mpsc_ring_try_push(&ring, VALUE(4)));
+    assert(!mpsc_ring_is_empty(&ring));
+
+    /* A popped value frees its cell. */
+    assert(mpsc_ring_pop(&ring, &value));
+    assert(value == VALUE(0));
+    assert(mpsc_ring_try_push(&ring, VALUE(4)));
+    assert(!mpsc_ring_try_push(&ring, VALUE(5)));
+
+    assert(mpsc_ring_pop_batch(&ring, ARRAY_SIZE(values), values) == 4);
+    for (i = 0; i < 4; i++) {
+        assert(values[i] == VALUE(i + 1));
+    }
+    assert(mpsc_ring_is_empty(&ring));
+
+    mpsc_ring_destroy(&ring);
+}
+
+static void
+test_mpsc_ring_batch(void)
+{
+    struct mpsc_ring ring;
+    void *values[9];
+    void *out[8];
+    size_t i, j;
+
+    assert(mpsc_ring_init(&ring, 8));
+    for (i = 0; i < ARRAY_SIZE(values); i++) {
+        values[i] = VALUE(i);
+    }
+
+    /* Batches are pushed entirely or not at all, across laps. */
+    for (j = 0; j < 10; j++) {
+        assert(mpsc_ring_try_push_batch(&ring, 5, values));
+        assert(!mpsc_ring_try_push_batch(&ring, 4, values));
+        assert(mpsc_ring_try_push_batch(&ring, 3, &values[5]));
+        assert(!mpsc_ring_try_push_batch(&ring, 1, values));
+        assert(mpsc_ring_pop_batch(&ring, ARRAY_SIZE(out), out) == 8);
+        for (i = 0; i < ARRAY_SIZE(out); i++) {
+            assert(out[i] == VALUE(i));
+        }
+    }
+    assert(!mpsc_ring_try_push_batch(&ring, 9, values));
+    assert(!mpsc_ring_try_push_batch(&ring, 0, values));
+    assert(mpsc_ring_is_empty(&ring));
+
+    mpsc_ring_destroy(&ring);
+}
+
+void
+test_mpsc_ring(void)
+{
+    test_mpsc_ring_full();
+    test_mpsc_ring_batch();
+}
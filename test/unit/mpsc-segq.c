@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "mpsc-segq.h"
+#include "unit.h"
+#include "util.h"
+
+#define VALUE(i) ((void *) (uintptr_t) ((i) + 1))
+
+static size_t
+n_spares(struct mpsc_segq *q)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < MPSC_SEGQ_N_SPARES; i++) {
+        n += atomic_load(&q->spares[i]) != NULL;
+    }
+    return n;
+}
+
+static void
+test_mpsc_segq_segments(void)
+{
+    size_t n = 3 * MPSC_SEGQ_SEGMENT_SIZE + 7;
+    struct mpsc_segq_producer p;
+    struct mpsc_segq q;
+    void *value;
+    size_t i;
+
+    assert(mpsc_segq_init(&q));
+    assert(mpsc_segq_producer_init(&p, &q));
+    assert(mpsc_segq_is_empty(&q));
+    assert(mpsc_segq_pop(&q) == NULL);
+
+    for (i = 0; i < n; i++) {
+        assert(mpsc_segq_insert(&p, VALUE(i)));
+    }
+    assert(!mpsc_segq_is_empty(&q));
+
+    /* The producer holds the last segment only, the others are
+     * recycled as soon as they are done. */
+    for (i = 0; i < n; i++) {
+        value = mpsc_segq_pop(&q);
+        assert(value == VALUE(i));
+    }
+    assert(mpsc_segq_pop(&q) == NULL);
+    assert(mpsc_segq_is_empty(&q));
+    assert(n_spares(&q) == 3);
+    assert(q.retired == NULL);
+
+    /* Recycled segments are used again. */
+    for (i = 0; i < MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        assert(mpsc_segq_insert(&p, VALUE(i)));
+    }
+    assert(n_spares(&q) == 2);
+    for (i = 0; i < MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        assert(mpsc_segq_pop(&q) == VALUE(i));
+    }
+
+    mpsc_segq_destroy(&q);
+}
+
+static void
+test_mpsc_segq_hazard(void)
+{
+    struct mpsc_segq_producer idle, p;
+    struct mpsc_segq_segment *first;
+    struct mpsc_segq q;
+    size_t i;
+
+    assert(mpsc_segq_init(&q));
+    assert(mpsc_segq_producer_init(&idle, &q));
+    assert(mpsc_segq_producer_init(&p, &q));
+
+    first = atomic_load(&q.tail);
+    assert(mpsc_segq_insert(&idle, VALUE(0)));
+    for (i = 1; i <= MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        assert(mpsc_segq_insert(&p, VALUE(i)));
+    }
+    for (i = 0; i <= MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        assert(mpsc_segq_pop(&q) == VALUE(i));
+    }
+
+    /* The first segment is done, but still held by 'idle'. */
+    assert(q.retired == first);
+    assert(n_spares(&q) == 0);
+
+    /* Its next insertion finds it full and moves to the tail. */
+    assert(mpsc_segq_insert(&idle, VALUE(0)));
+    assert(idle.segment != first);
+    assert(mpsc_segq_pop(&q) == VALUE(0));
+    mpsc_segq_producer_release(&idle);
+    mpsc_segq_producer_release(&p);
+
+    /* Deferred segments are recycled with the next done one. */
+    for (i = 0; i < MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        assert(mpsc_segq_insert(&p, VALUE(i)));
+    }
+    for (i = 0; i < MPSC_SEGQ_SEGMENT_SIZE; i++) {
+        assert(mpsc_segq_pop(&q) == VALUE(i));
+    }
+    assert(q.retired == NULL);
+    assert(n_spares(&q) == 2);
+
+    mpsc_segq_destroy(&q);
+}
+
+static void
+test_mpsc_segq_batch(void)
+{
+    size_t n = MPSC_SEGQ_SEGMENT_SIZE / 64 * 64;
+    struct mpsc_segq_producer p;
+    struct mpsc_segq q;
+    void *values[100];
+    void *out[64];
+    size_t i, j, k;
+
+    assert(mpsc_segq_init(&q));
+    assert(mpsc_segq_producer_init(&p, &q));
+    for (i = 0; i < ARRAY_SIZE(values); i++) {
+        values[i] = VALUE(i);
+    }
+
+    /* Batches of 100 end up across segment boundaries. */
+    for (i = 0; i < n; i++) {
+        assert(mpsc_segq_insert_batch(&p, ARRAY_SIZE(values), values));
+    }
+    k = 0;
+    for (i = 0; i < n * ARRAY_SIZE(values) / ARRAY_SIZE(out); i++) {
+        assert(mpsc_segq_pop_batch(&q, ARRAY_SIZE(out), out)
+               == ARRAY_SIZE(out));
+        for (j = 0; j < ARRAY_SIZE(out); j++) {
+            assert(out[j] == VALUE(k % ARRAY_SIZE(values)));
+            k++;
+        }
+    }
+    assert(mpsc_segq_pop_batch(&q, ARRAY_SIZE(out), out) == 0);
+    assert(mpsc_segq_insert_batch(&p, 0, values));
+    assert(mpsc_segq_is_empty(&q));
+
+    mpsc_segq_destroy(&q);
+}
+
+#define N_PRODUCERS 4
+#define N_VALUES (16 * MPSC_SEGQ_SEGMENT_SIZE)
+#define MAX_BATCH 100
+
+struct producer_test {
+    struct mpsc_segq_producer p;
+    size_t id;
+};
+
+static void *
+producer_test_main(void *aux)
+{
+    struct producer_test *t = aux;
+    void *values[MAX_BATCH];
+    size_t i = 0;
+    size_t n;
+
+    /* Single insertions and batches of varying sizes, for batches to
+     * overflow their segment while other producers insert. */
+    while (i < N_VALUES) {
+        n = i % 3 ? 1 : (i % MAX_BATCH) + 1;
+        if (n > N_VALUES - i) {
+            n = N_VALUES - i;
+        }
+        for (size_t j = 0; j < n; j++) {
+            values[j] = VALUE(t->id * N_VALUES + i + j);
+        }
+        if (n == 1) {
+            assert(mpsc_segq_insert(&t->p, values[0]));
+        } else {
+            assert(mpsc_segq_insert_batch(&t->p, n, values));
+        }
+        i += n;
+    }
+    mpsc_segq_producer_release(&t->p);
+    return NULL;
+}
+
+/* Each producer's values come out in order, none lost nor duplicated,
+ * while segments are recycled under the producers. */
+static void
+test_mpsc_segq_threads(void)
+{
+    struct producer_test tests[N_PRODUCERS];
+    pthread_t threads[N_PRODUCERS];
+    size_t next[N_PRODUCERS] = { 0 };
+    struct mpsc_segq q;
+    size_t n_popped = 0;
+    uintptr_t value;
+    size_t id;
+    size_t i;
+
+    assert(mpsc_segq_init(&q));
+    for (i = 0; i < N_PRODUCERS; i++) {
+        tests[i].id = i;
+        assert(mpsc_segq_producer_init(&tests[i].p, &q));
+        assert(!pthread_create(&threads[i], NULL, producer_test_main,
+                               &tests[i]));
+    }
+
+    while (n_popped < N_PRODUCERS * N_VALUES) {
+        value = (uintptr_t) mpsc_segq_pop(&q);
+        if (value == 0) {
+            sched_yield();
+            continue;
+        }
+        value--;
+        id = value / N_VALUES;
+        assert(id < N_PRODUCERS);
+        assert(value % N_VALUES == next[id]);
+        next[id]++;
+        n_popped++;
+    }
+
+    for (i = 0; i < N_PRODUCERS; i++) {
+        assert(!pthread_join(threads[i], NULL));
+        assert(next[i] == N_VALUES);
+    }
+    assert(mpsc_segq_pop(&q) == NULL);
+    assert(mpsc_segq_is_empty(&q));
+
+    mpsc_segq_destroy(&q);
+}
+
+void
+test_mpsc_segq(void)
+{
+    test_mpsc_segq_segments();
+    test_mpsc_segq_hazard();
+    test_mpsc_segq_batch();
+    test_mpsc_segq_threads();
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "tailq.h"
+#include "unit.h"
+#include "util.h"
+
+#define N_THREADS 4
+#define N_LOCKS 10000
+/* Lock holders yield the CPU every so often, for the other threads to
+ * queue up behind them even on a single CPU. */
+#define YIELD_INTERVAL 64
+
+struct lock_test {
+    struct tailq_lock lock;
+    /* Protected by 'lock', deliberately not atomic. */
+    unsigned long counter;
+};
+
+static void *
+lock_test_main(void *aux)
+{
+    struct lock_test *t = aux;
+
+    for (unsigned int i = 0; i < N_LOCKS; i++) {
+        tailq_lock(&t->lock);
+        t->counter++;
+        if (i % YIELD_INTERVAL == 0) {
+            unsigned long counter = t->counter;
+
+            sched_yield();
+            assert(t->counter == counter);
+        }
+        tailq_unlock(&t->lock);
+    }
+    return NULL;
+}
+
+static void
+test_tailq_lock_exclusion(enum tailq_lock_type type)
+{
+    pthread_t threads[N_THREADS];
+    struct lock_test t;
+    size_t i;
+
+    tailq_lock_init(&t.lock, type);
+    t.counter = 0;
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++) {
+        assert(!pthread_create(&threads[i], NULL, lock_test_main, &t));
+    }
+    for (i = 0; i < ARRAY_SIZE(threads); i++) {
+        assert(!pthread_join(threads[i], NULL));
+    }
+    assert(t.counter == (unsigned long) N_THREADS * N_LOCKS);
+
+    if (type == TAILQ_LOCK_TICKET) {
+        assert(atomic_load(&t.lock.ticket.owner)
+               == atomic_load(&t.lock.ticket.next));
+    } else if (type == TAILQ_LOCK_MCS) {
+        assert(atomic_load(&t.lock.mcs) == NULL);
+    }
+}
+
+struct mcs_link {
+    struct tailq_mcs_node *prev;
+    struct tailq_mcs_node *node;
+};
+
+static void *
+mcs_link_main(void *aux)
+{
+    struct mcs_link *link = aux;
+    struct timespec delay = { .tv_nsec = 10 * 1000 * 1000 };
+
+    nanosleep(&delay, NULL);
+    atomic_store(&link->prev->next, link->node);
+    return NULL;
+}
+
+/* A waiter that swapped itself in as the lock tail but did not link
+ * itself to its predecessor yet: the holder must wait for the link on
+ * unlock, then hand the lock over. */
+static void
+test_tailq_lock_mcs_late_link(void)
+{
+    struct tailq_mcs_node waiter;
+    struct tailq_mcs_node *tail;
+    struct tailq_lock lock;
+    struct mcs_link link;
+    pthread_t thread;
+
+    tailq_lock_init(&lock, TAILQ_LOCK_MCS);
+    tailq_lock(&lock);
+
+    atomic_store(&waiter.next, NULL);
+    atomic_store(&waiter.locked, true);
+    link.prev = atomic_exchange(&lock.mcs, &waiter);
+    link.node = &waiter;
+    assert(link.prev == &tailq_mcs_local);
+    assert(!pthread_create(&thread, NULL, mcs_link_main, &link));
+
+    tailq_unlock(&lock);
+    assert(!pthread_join(thread, NULL));
+    assert(atomic_load(&waiter.locked) == false);
+
+    /* Release on behalf of the waiter, now the only holder. */
+    tail = &waiter;
+    assert(atomic_compare_exchange_strong(&lock.mcs, &tail, NULL));
+}
+
+void
+test_tailq(void)
+{
+    static const enum tailq_lock_type types[] = {
+        TAILQ_LOCK_MUTEX,
+        TAILQ_LOCK_SPIN,
+        TAILQ_LOCK_TICKET,
+        TAILQ_LOCK_MCS,
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(types); i++) {
+        test_tailq_lock_exclusion(types[i]);
+    }
+    test_tailq_lock_mcs_late_link();
+}
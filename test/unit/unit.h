@@ -2,5 +2,15 @@
 #define UNIT_H
 
 void test_mpsc_queue(void);
+void test_mpsc_queue_wait(void);
+void test_mpsc_queue_bounded(void);
+void test_mpsc_queue_pool(void);
+void test_mpsc_queue_batch(void);
+void test_mpsc_queue_stats(void);
+void test_mpsc_ring(void);
+void test_mpsc_segq(void);
+void test_fc_mpsc_queue(void);
+void test_tailq(void);
+void test_histogram(void);
 
 #endif /* UNIT_H */
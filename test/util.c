@@ -75,6 +75,12 @@ timespec_to_usec(const struct timespec *ts)
     return (long long int) ts->tv_sec * 1000 * 1000 + ts->tv_nsec / 1000;
 }
 
+long long int
+timespec_to_nsec(const struct timespec *ts)
+{
+    return (long long int) ts->tv_sec * 1000 * 1000 * 1000 + ts->tv_nsec;
+}
+
 long long int
 time_usec(void)
 {
@@ -84,6 +90,15 @@ time_usec(void)
     return timespec_to_usec(&ts);
 }
 
+long long int
+time_nsec(void)
+{
+    struct timespec ts;
+
+    xclock_gettime(&ts);
+    return timespec_to_nsec(&ts);
+}
+
 bool
 str_to_uint(const char *s, int base, unsigned int *result)
 {
@@ -28,6 +28,8 @@
        __typeof__ (a) _b = (b); \
      _a > _b ? _a : _b; })
 
+#define ROUND_UP(x, y) ((((x) + (y) - 1) / (y)) * (y))
+
 extern uint32_t rand_seed;
 
 /* The state word must be initialized to non-zero */
@@ -64,7 +66,9 @@ void xclock_gettime(struct timespec *ts);
 
 long long int timespec_to_msec(const struct timespec *ts);
 long long int timespec_to_usec(const struct timespec *ts);
+long long int timespec_to_nsec(const struct timespec *ts);
 long long int time_usec(void);
+long long int time_nsec(void);
 
 bool str_to_uint(const char *s, int base, unsigned int *result);
 
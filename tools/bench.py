@@ -3,8 +3,11 @@
 # Copyright(c) 2023 Gaëtan Rivet
 
 import csv
+import math
 import optparse
 import os
+import random
+import re
 import statistics
 import shutil
 import subprocess
@@ -101,26 +104,103 @@ def show(args):
 commands.append(show)
 
 
-def printResultComparison(a, b):
-    maxlen = max([len(n) for n in a.keys()])
-
-    def delta(x1: float, x2: float):
-        diff = x2 - x1
-        pc = x1 if x1 == 0 else (diff / x1) * 100
-        return '{:+6.1f}% {:18s}'.format(pc,
-                '({:.1f} -> {:.1f})'.format(x1, x2))
+def rejectOutliers(values: list):
+    """Drop values beyond the Tukey fences, 1.5 IQR past the quartiles."""
+    if len(values) < 4:
+        return values
+    q1, _, q3 = statistics.quantiles(values, n=4)
+    lo = q1 - 1.5 * (q3 - q1)
+    hi = q3 + 1.5 * (q3 - q1)
+    return [x for x in values if lo <= x <= hi]
+
+
+def mannWhitneyU(v: list, w: list):
+    """Two-sided p-value of the Mann-Whitney U test, with the normal
+    approximation, corrected for ties and continuity."""
+    n1, n2 = len(v), len(w)
+    both = sorted([(x, 0) for x in v] + [(x, 1) for x in w])
+    ranks = [0.0] * len(both)
+    ties = 0.0
+    i = 0
+    while i < len(both):
+        j = i
+        while j + 1 < len(both) and both[j + 1][0] == both[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2 + 1
+        t = j - i + 1
+        ties += t ** 3 - t
+        i = j + 1
+    r1 = sum(r for r, (_, side) in zip(ranks, both) if side == 0)
+    u = r1 - n1 * (n1 + 1) / 2
+    n = n1 + n2
+    var = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))) if n > 1 else 0
+    if var <= 0:
+        return 1.0
+    z = (abs(u - n1 * n2 / 2) - 0.5) / math.sqrt(var)
+    return min(1.0, math.erfc(max(z, 0) / math.sqrt(2)))
+
+
+def bootstrapDelta(v: list, w: list, n=2000, confidence=0.95):
+    """Confidence interval of the relative change of the median, in %."""
+    rng = random.Random(0)
+    m1 = statistics.median(v)
+    if m1 == 0:
+        return None
+    deltas = []
+    for _ in range(n):
+        a = statistics.median(rng.choices(v, k=len(v)))
+        b = statistics.median(rng.choices(w, k=len(w)))
+        if a != 0:
+            deltas += [(b - a) / a * 100]
+    deltas.sort()
+    if not deltas:
+        return None
+    lo = deltas[int((1 - confidence) / 2 * (len(deltas) - 1))]
+    hi = deltas[int((1 + confidence) / 2 * (len(deltas) - 1))]
+    return lo, hi
+
+
+def higherIsBetter(name: str):
+    return 'throughput' in name
 
-    def printDelta(name: str, v: list, w: list):
-        m1 = statistics.mean(v)
-        s1 = statistics.pstdev(v)
-        m2 = statistics.mean(w)
-        s2 = statistics.pstdev(w)
-        print('{: >{}s}: mean {:s}\tstdev {:s}'.format(
-            name, maxlen,
-            delta(m1, m2), delta(s1, s2)))
 
-    for k in a.keys():
-        printDelta(k, a[k], b[k])
+def printResultComparison(a, b):
+    """Returns the names of the values that significantly regressed
+    by more than the threshold."""
+    keys = [k for k in a.keys() if k in b]
+    if options.keys:
+        keys = [k for k in keys if re.search(options.keys, k)]
+    if not keys:
+        return []
+    maxlen = max([len(n) for n in keys])
+    regressions = []
+
+    for k in keys:
+        v = rejectOutliers(a[k])
+        w = rejectOutliers(b[k])
+        m1 = statistics.median(v)
+        m2 = statistics.median(w)
+        pc = 0 if m1 == 0 else (m2 - m1) / m1 * 100
+        p = mannWhitneyU(v, w)
+        ci = bootstrapDelta(v, w)
+        # Positive when worse.
+        sign = -1 if higherIsBetter(k) else 1
+        regressed = False
+        if options.threshold is not None and ci is not None:
+            worst_lo = min(sign * ci[0], sign * ci[1])
+            regressed = p < options.alpha and worst_lo > options.threshold
+        if regressed:
+            regressions += [k]
+
+        print('{: >{}s}: median {:+6.1f}% {:18s} ci {:18s} p {:.3f}{}{}'.format(
+            k, maxlen, pc, '({:.1f} -> {:.1f})'.format(m1, m2),
+            '[{:+.1f}%, {:+.1f}%]'.format(*ci) if ci else 'n/a', p,
+            ' outliers {}/{}'.format(len(a[k]) - len(v), len(b[k]) - len(w))
+            if len(v) != len(a[k]) or len(w) != len(b[k]) else '',
+            ' REGRESSION' if regressed else ''))
+
+    return regressions
 
 
 def compare(args):
@@ -128,18 +208,209 @@ def compare(args):
         eprint("Using 'compare' requires at least 2 files.")
         return
 
+    regressions = []
     for pairs in list(zip(args, args[1:])):
         print('Comparing %s -> %s:' % (pairs[0], pairs[1]))
         with open(pairs[0], newline='') as a:
             resultA = loadResult(a)
         with open(pairs[1], newline='') as b:
             resultB = loadResult(b)
-        printResultComparison(resultA, resultB)
+        regressions += printResultComparison(resultA, resultB)
+
+    if regressions:
+        eprint('%d significant regressions above %.1f%%: %s' %
+               (len(regressions), options.threshold, ', '.join(regressions)))
+        sys.exit(1)
 
 
 commands.append(compare)
 
 
+def parseList(text: str):
+    return [int(x) for x in text.split(',') if x]
+
+
+def defaultThreads():
+    # One core is left to the consumer.
+    ncpu = max((os.cpu_count() or 2) - 1, 1)
+    threads = [1]
+    while threads[-1] * 2 <= ncpu:
+        threads += [threads[-1] * 2]
+    if threads[-1] != ncpu:
+        threads += [ncpu]
+    return threads
+
+
+# Keys of the bench are '<desc>-<batch>-<metric>'.
+keyRegex = re.compile(r'^(.+?)-(\d+)-(.+)$')
+
+
+def sweepRun(cmd: str, threads: int, batch: int, elems: int, n: int):
+    rows = []
+    test = '%s --csv -c %d -b %d -n %d' % (cmd, threads, batch, elems)
+    for i in range(n):
+        for line in _sh(test, capture=True):
+            k, v = line.decode().strip().split(',')
+            m = keyRegex.match(k)
+            desc, metric = (m.group(1), m.group(3)) if m else ('', k)
+            rows += [dict(threads=threads, batch=batch, elems=elems, run=i,
+                          desc=desc, metric=metric, value=int(v))]
+    return rows
+
+
+def throughputCurves(rows):
+    """Median throughput per core, in msg/s, for each (batch, elems)
+    and desc, indexed by the number of producers."""
+    samples = dict()
+    for row in rows:
+        if row['desc'] == '' or row['metric'] != 'consumer':
+            continue
+        ms = max(row['value'], 1)
+        # Producers and the consumer.
+        cores = row['threads'] + 1
+        tput = row['elems'] * 1000 / ms / cores
+        key = (row['batch'], row['elems'])
+        series = samples.setdefault(key, dict()).setdefault(row['desc'], dict())
+        series.setdefault(row['threads'], []).append(tput)
+    return {k: {desc: {t: statistics.median(v) for t, v in sorted(s.items())}
+                for desc, s in c.items()}
+            for k, c in samples.items()}
+
+
+def knee(curve: dict):
+    """Number of producers after which adding some raises the total
+    throughput by less than 10%."""
+    threads = sorted(curve)
+    for t, u in zip(threads, threads[1:]):
+        if curve[u] * (u + 1) < curve[t] * (t + 1) * 1.1:
+            return t
+    return None
+
+
+def asciiPlot(title: str, curves: dict, height=16):
+    symbols = '*o+x#@%&=~'
+    threads = sorted({t for c in curves.values() for t in c})
+    top = max(v for c in curves.values() for v in c.values()) or 1
+    colw = 6
+    grid = [[' '] * (len(threads) * colw) for _ in range(height)]
+    for i, (desc, curve) in enumerate(sorted(curves.items())):
+        for t, v in curve.items():
+            y = min(int(v / top * (height - 1) + 0.5), height - 1)
+            x = threads.index(t) * colw + colw // 2
+            # Overlapping points of different series.
+            cell = grid[height - 1 - y][x]
+            grid[height - 1 - y][x] = symbols[i % len(symbols)] \
+                if cell == ' ' else '?'
+
+    print(title)
+    for j, line in enumerate(grid):
+        label = top * (height - 1 - j) / (height - 1)
+        print('{:>10.3g} |{}'.format(label, ''.join(line)))
+    print('{:>10s} +{}'.format('', '-' * (len(threads) * colw)))
+    print('{:>10s}  {}'.format('producers', ''.join(
+        '{:^{}d}'.format(t, colw) for t in threads)))
+    for i, (desc, curve) in enumerate(sorted(curves.items())):
+        k = knee(curve)
+        print('{:>12s} {}: {}'.format(symbols[i % len(symbols)], desc,
+              'knee at %d producers' % k if k is not None
+              else 'no knee up to %d producers' % max(curve)))
+    print('{:>12s} several series'.format('?'))
+    print()
+
+
+def svgPlot(file: str, title: str, curves: dict):
+    colors = ['#1f77b4', '#ff7f0e', '#2ca02c', '#d62728', '#9467bd',
+              '#8c564b', '#e377c2', '#7f7f7f', '#bcbd22', '#17becf']
+    width, height = 640, 400
+    left, right, top_, bottom = 80, 180, 40, 50
+    pw, ph = width - left - right, height - top_ - bottom
+    threads = sorted({t for c in curves.values() for t in c})
+    top = max(v for c in curves.values() for v in c.values()) or 1
+
+    def px(t):
+        if len(threads) == 1:
+            return left + pw / 2
+        return left + threads.index(t) * pw / (len(threads) - 1)
+
+    def py(v):
+        return top_ + ph - v / top * ph
+
+    out = ['<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" '
+           'font-family="sans-serif" font-size="12">' % (width, height),
+           '<rect width="100%" height="100%" fill="white"/>',
+           '<text x="%d" y="20" font-size="14">%s</text>' % (left, title),
+           '<line x1="%d" y1="%d" x2="%d" y2="%d" stroke="black"/>' %
+           (left, top_ + ph, left + pw, top_ + ph),
+           '<line x1="%d" y1="%d" x2="%d" y2="%d" stroke="black"/>' %
+           (left, top_, left, top_ + ph)]
+    for i in range(5):
+        v = top * i / 4
+        out += ['<text x="%d" y="%.1f" text-anchor="end">%.3g</text>' %
+                (left - 5, py(v) + 4, v),
+                '<line x1="%d" y1="%.1f" x2="%d" y2="%.1f" stroke="#ddd"/>' %
+                (left, py(v), left + pw, py(v))]
+    for t in threads:
+        out += ['<text x="%.1f" y="%d" text-anchor="middle">%d</text>' %
+                (px(t), top_ + ph + 18, t)]
+    out += ['<text x="%.1f" y="%d" text-anchor="middle">producers</text>' %
+            (left + pw / 2, height - 10),
+            '<text x="15" y="%.1f" transform="rotate(-90 15 %.1f)" '
+            'text-anchor="middle">msg/s per core</text>' %
+            (top_ + ph / 2, top_ + ph / 2)]
+    for i, (desc, curve) in enumerate(sorted(curves.items())):
+        color = colors[i % len(colors)]
+        points = ' '.join('%.1f,%.1f' % (px(t), py(v))
+                          for t, v in sorted(curve.items()))
+        out += ['<polyline fill="none" stroke="%s" stroke-width="2" '
+                'points="%s"/>' % (color, points)]
+        for t, v in curve.items():
+            out += ['<circle cx="%.1f" cy="%.1f" r="3" fill="%s"/>' %
+                    (px(t), py(v), color)]
+        out += ['<text x="%d" y="%d" fill="%s">%s</text>' %
+                (left + pw + 10, top_ + 15 + i * 18, color, desc)]
+    out += ['</svg>']
+    with open(file, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+def sweep(args):
+    if len(args) == 0:
+        eprint("Using 'sweep' requires the bench command after '--'.")
+        sys.exit(1)
+
+    cmd = ' '.join(args)
+    n = options.n or 3
+    threads = parseList(options.threads) if options.threads \
+              else defaultThreads()
+    batches = parseList(options.batches)
+    elems = parseList(options.elems)
+    grid = [(t, b, e) for e in elems for b in batches for t in threads]
+
+    rows = []
+    eprint('Running %d times %s over %d configurations:' %
+           (n, cmd, len(grid)))
+    for t, b, e in progressbar(grid, out=sys.stderr):
+        rows += sweepRun(cmd, t, b, e, n)
+
+    fields = ['threads', 'batch', 'elems', 'run', 'desc', 'metric', 'value']
+    with open(options.output, 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(rows)
+    eprint('Results written to %s.' % options.output)
+
+    prefix = os.path.splitext(options.output)[0]
+    for (b, e), curves in sorted(throughputCurves(rows).items()):
+        title = 'Throughput per core, batch=%d, n=%d' % (b, e)
+        asciiPlot(title, curves)
+        svg = '%s-b%d-n%d.svg' % (prefix, b, e)
+        svgPlot(svg, title, curves)
+        eprint('Plot written to %s.' % svg)
+
+
+commands.append(sweep)
+
+
 def doc(args):
     parser.print_help()
     print("""
@@ -162,8 +433,27 @@ other with the 'compare' command, e.g. :
   ./bench.py run -- command -csv > run.2.csv
   ./bench.py compare run.{1,2}.csv
 
-The mean and stdev of each rows is computed, then the comparison
-shows the difference between the two measures.""")
+Outliers are removed from each row, beyond 1.5 times the interquartile
+range. The comparison shows the change of the median, its bootstrapped
+95% confidence interval, and the p-value of a Mann-Whitney U test.
+
+With '--threshold PCT', 'compare' exits with status 1 if a value is
+worse by more than PCT%, with confidence: its p-value is below '--alpha'
+and its whole confidence interval lies beyond PCT%. Values are worse
+when higher, except throughputs. '--keys REGEX' restricts the values
+compared, e.g. to gate on the consumer times only:
+
+  ./bench.py compare --threshold 5 --keys consumer base.csv new.csv
+
+The 'sweep' command runs the bench over a grid of producer counts,
+batch sizes and element counts, e.g. :
+
+  ./bench.py sweep --threads 1,2,4,8 --batches 1,64 -o sweep.csv -- ./bench
+
+All values are written to a single CSV, one per row. The throughput
+per core of each queue is plotted against the number of producers,
+in the terminal and in an SVG file next to the CSV, for each batch
+size and element count.""")
     sys.exit(0)
 
 
@@ -183,6 +473,22 @@ def main():
                       help='Run command N times')
     parser.add_option('-H', '--human', dest='human', action='store_true',
                       default=False, help='Format output for a human reader')
+    parser.add_option('--threshold', dest='threshold', metavar='PCT',
+                      type='float', help='Fail compare on a significant '
+                      'regression larger than PCT%')
+    parser.add_option('--alpha', dest='alpha', metavar='P', type='float',
+                      default=0.05, help='Significance level of compare')
+    parser.add_option('--keys', dest='keys', metavar='REGEX',
+                      help='Only compare the values matching REGEX')
+    parser.add_option('--threads', dest='threads', metavar='LIST',
+                      help='Producer counts to sweep, default powers of 2 '
+                      'up to the number of CPUs minus one')
+    parser.add_option('--batches', dest='batches', metavar='LIST',
+                      default='64', help='Batch sizes to sweep')
+    parser.add_option('--elems', dest='elems', metavar='LIST',
+                      default='1000000', help='Element counts to sweep')
+    parser.add_option('-o', '--output', dest='output', metavar='FILE',
+                      default='sweep.csv', help='CSV written by sweep')
 
     options, args = parser.parse_args()
 